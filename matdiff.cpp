@@ -0,0 +1,314 @@
+/*
+ * University of Antioquia - Operating Systems Course
+ * Practice #3 - Matrix Multiplication Using Processes
+ *
+ * matdiff: streaming comparator for matrix files (text or binary).
+ *
+ * Both files are read chunk by chunk, so memory use is bounded by the chunk
+ * size regardless of the matrix size. Each chunk is compared by several
+ * threads while the next one is being parsed.
+ *
+ * Exit status: 0 if the matrices match, 1 if they differ, 2 on errors.
+ */
+
+ #include <iostream>
+ #include <vector>
+ #include <string>
+ #include <thread>
+ #include <cmath>
+ #include <cstring>
+ #include <cstdint>
+ #include <climits>
+ #include <getopt.h>
+ #include <iomanip>
+ #include <limits>
+ #include <unistd.h>
+ #include "matrix_io.h"
+
+ using namespace std;
+
+// Thresholds that decide whether two elements match. An element matches if it
+// satisfies any of the enabled criteria.
+struct Tolerance {
+    long max_ulp = -1;      // disabled when negative
+    double rtol = -1.0;     // disabled when negative
+    double atol = 0.0;
+};
+
+struct Mismatch {
+    long row;
+    long col;
+    double a;
+    double b;
+    uint64_t ulp;
+};
+
+// Error statistics for a range of elements
+struct DiffStats {
+    long compared = 0;
+    long mismatches = 0;
+    double max_abs = 0.0;
+    double max_rel = 0.0;
+    uint64_t max_ulp = 0;
+    double sum_abs = 0.0;
+    vector<Mismatch> first;
+};
+
+const long DEFAULT_CHUNK_ROWS = 256;
+const int DEFAULT_REPORT = 10;
+const double DEFAULT_RTOL = 1e-9;
+
+// Function declarations
+uint64_t ulpDistance(double a, double b);
+bool elementsMatch(double a, double b, uint64_t ulp, const Tolerance& tol);
+void compareRows(const double* a, const double* b, long first_row, long rows, long cols,
+                 const Tolerance& tol, int max_report, DiffStats& stats);
+void mergeStats(DiffStats& total, const DiffStats& part, int max_report);
+void printUsage(const char* programName);
+
+// Function to map a double to an integer whose ordering matches the ordering
+// of the floating point values, and return the distance between two of them
+uint64_t ulpDistance(double a, double b) {
+    int64_t ia, ib;
+    memcpy(&ia, &a, sizeof(double));
+    memcpy(&ib, &b, sizeof(double));
+    if (ia < 0) ia = INT64_MIN - ia;
+    if (ib < 0) ib = INT64_MIN - ib;
+    return ia > ib ? (uint64_t)ia - (uint64_t)ib : (uint64_t)ib - (uint64_t)ia;
+}
+
+// Function to check one pair of elements against the thresholds
+bool elementsMatch(double a, double b, uint64_t ulp, const Tolerance& tol) {
+    if (isnan(a) || isnan(b)) return isnan(a) && isnan(b);
+    if (a == b) return true;
+    if (tol.max_ulp >= 0 && ulp <= (uint64_t)tol.max_ulp) return true;
+    if (tol.rtol >= 0 && fabs(a - b) <= tol.atol + tol.rtol * max(fabs(a), fabs(b))) return true;
+    return false;
+}
+
+// Function to compare a block of rows, collecting statistics and the first mismatches
+void compareRows(const double* a, const double* b, long first_row, long rows, long cols,
+                 const Tolerance& tol, int max_report, DiffStats& stats) {
+    for (long i = 0; i < rows; i++) {
+        for (long j = 0; j < cols; j++) {
+            double x = a[i * cols + j];
+            double y = b[i * cols + j];
+            uint64_t ulp = ulpDistance(x, y);
+            double abs_err = fabs(x - y);
+
+            if (!isnan(abs_err)) {
+                double scale = max(fabs(x), fabs(y));
+                double rel_err = scale > 0 ? abs_err / scale : 0.0;
+                stats.max_abs = max(stats.max_abs, abs_err);
+                stats.max_rel = max(stats.max_rel, rel_err);
+                stats.max_ulp = max(stats.max_ulp, ulp);
+                stats.sum_abs += abs_err;
+            }
+
+            if (!elementsMatch(x, y, ulp, tol)) {
+                if ((int)stats.first.size() < max_report) {
+                    stats.first.push_back({first_row + i, j, x, y, ulp});
+                }
+                stats.mismatches++;
+            }
+        }
+    }
+    stats.compared += rows * cols;
+}
+
+// Function to merge the statistics of a later block into the running totals
+void mergeStats(DiffStats& total, const DiffStats& part, int max_report) {
+    total.compared += part.compared;
+    total.mismatches += part.mismatches;
+    total.max_abs = max(total.max_abs, part.max_abs);
+    total.max_rel = max(total.max_rel, part.max_rel);
+    total.max_ulp = max(total.max_ulp, part.max_ulp);
+    total.sum_abs += part.sum_abs;
+    for (const Mismatch& m : part.first) {
+        if ((int)total.first.size() >= max_report) break;
+        total.first.push_back(m);
+    }
+}
+
+void printUsage(const char* programName) {
+    cout << "Usage: " << programName << " <matrix_1_file> <matrix_2_file> [options]" << endl;
+    cout << "Options:" << endl;
+    cout << "  --max-ulp <n>        Accept elements at most n ULPs apart" << endl;
+    cout << "  --rtol <x>           Accept |a - b| <= atol + x * max(|a|, |b|) (default: " << DEFAULT_RTOL
+         << " unless --max-ulp is given)" << endl;
+    cout << "  --atol <x>           Absolute tolerance added to --rtol (default: 0)" << endl;
+    cout << "  --report <k>         Number of mismatches to print (default: " << DEFAULT_REPORT << ")" << endl;
+    cout << "  --chunk-rows <r>     Rows read per chunk (default: " << DEFAULT_CHUNK_ROWS << ")" << endl;
+    cout << "  -j <threads>         Comparison threads (default: number of cores)" << endl;
+    cout << endl;
+    cout << "Exit status: 0 if the matrices match, 1 if they differ, 2 on errors." << endl;
+    cout << endl;
+    cout << "Examples:" << endl;
+    cout << "  " << programName << " output_4/C_seq.txt output_4/C_parallel_4.txt" << endl;
+    cout << "  " << programName << " C_seq.txt C.bin --max-ulp 4" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    string file1 = argv[1];
+    string file2 = argv[2];
+    Tolerance tol;
+    int max_report = DEFAULT_REPORT;
+    long chunk_rows = DEFAULT_CHUNK_ROWS;
+    int num_threads = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+
+    static struct option long_options[] = {
+        {"max-ulp", required_argument, 0, 'u'},
+        {"rtol", required_argument, 0, 'r'},
+        {"atol", required_argument, 0, 'a'},
+        {"report", required_argument, 0, 'k'},
+        {"chunk-rows", required_argument, 0, 'c'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc - 2, argv + 2, "j:", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 'u':
+                tol.max_ulp = atol(optarg);
+                break;
+            case 'r':
+                tol.rtol = atof(optarg);
+                break;
+            case 'a':
+                tol.atol = atof(optarg);
+                break;
+            case 'k':
+                max_report = max(0, atoi(optarg));
+                break;
+            case 'c':
+                chunk_rows = atol(optarg);
+                if (chunk_rows <= 0) {
+                    cerr << "Error: Chunk size must be positive" << endl;
+                    return 2;
+                }
+                break;
+            case 'j':
+                num_threads = atoi(optarg);
+                if (num_threads <= 0) {
+                    cerr << "Error: Number of threads must be positive" << endl;
+                    return 2;
+                }
+                break;
+            default:
+                printUsage(argv[0]);
+                return 2;
+        }
+    }
+
+    if (tol.max_ulp < 0 && tol.rtol < 0) {
+        tol.rtol = DEFAULT_RTOL;
+    }
+
+    MatrixStreamReader reader1, reader2;
+    if (!reader1.open(file1)) {
+        cerr << reader1.error() << endl;
+        return 2;
+    }
+    if (!reader2.open(file2)) {
+        cerr << reader2.error() << endl;
+        return 2;
+    }
+
+    // Two chunks per file: one being compared while the next is parsed
+    vector<double> chunk1[2], chunk2[2];
+    long got1[2], got2[2];
+    int cur = 0;
+    bool io_error = false;
+    bool shape_error = false;
+    long cols = -1;
+    long row = 0;
+    DiffStats total;
+
+    auto readChunk = [&](int slot) {
+        chunk1[slot].clear();
+        chunk2[slot].clear();
+        thread t([&] { got1[slot] = reader1.readRows(chunk1[slot], chunk_rows); });
+        got2[slot] = reader2.readRows(chunk2[slot], chunk_rows);
+        t.join();
+    };
+
+    readChunk(cur);
+    for (;;) {
+        if (got1[cur] < 0 || got2[cur] < 0) {
+            cerr << (got1[cur] < 0 ? reader1.error() : reader2.error()) << endl;
+            io_error = true;
+            break;
+        }
+        if (reader1.cols() != reader2.cols() || got1[cur] != got2[cur]) {
+            shape_error = true;
+            break;
+        }
+        if (got1[cur] == 0) break;
+
+        cols = reader1.cols();
+        long rows = got1[cur];
+
+        // Parse the next chunk while this one is compared
+        int next = 1 - cur;
+        thread reader_thread(readChunk, next);
+
+        int workers = (int)min<long>(num_threads, rows);
+        vector<DiffStats> parts(workers);
+        vector<thread> threads;
+        long per_thread = rows / workers;
+        long extra = rows % workers;
+        for (int t = 0; t < workers; t++) {
+            long start = t * per_thread + min<long>(t, extra);
+            long end = (t + 1) * per_thread + min<long>(t + 1, extra);
+            threads.emplace_back(compareRows, chunk1[cur].data() + start * cols, chunk2[cur].data() + start * cols,
+                                 row + start, end - start, cols, cref(tol), max_report, ref(parts[t]));
+        }
+        for (thread& t : threads) {
+            t.join();
+        }
+        for (const DiffStats& part : parts) {
+            mergeStats(total, part, max_report);
+        }
+
+        row += rows;
+        reader_thread.join();
+        cur = next;
+    }
+
+    if (io_error) {
+        return 2;
+    }
+
+    if (shape_error) {
+        // Drain both files to report their full shapes
+        vector<double> scratch;
+        while (reader1.readRows(scratch, chunk_rows) > 0) scratch.clear();
+        while (reader2.readRows(scratch, chunk_rows) > 0) scratch.clear();
+        cout << "Shape mismatch: " << file1 << " is " << reader1.rowsRead() << "x" << reader1.cols()
+             << ", " << file2 << " is " << reader2.rowsRead() << "x" << reader2.cols() << endl;
+        cout << "FAILED" << endl;
+        return 1;
+    }
+
+    cout << setprecision(numeric_limits<double>::max_digits10);
+    for (const Mismatch& m : total.first) {
+        cout << "Mismatch at (" << m.row << ", " << m.col << "): " << m.a << " vs " << m.b
+             << " (" << m.ulp << " ULP)" << endl;
+    }
+
+    cout << "Compared: " << row << "x" << max(cols, 0L) << " (" << total.compared << " elements)" << endl;
+    cout << scientific << setprecision(6);
+    cout << "Max abs error: " << total.max_abs << endl;
+    cout << "Max rel error: " << total.max_rel << endl;
+    cout << "Mean abs error: " << (total.compared > 0 ? total.sum_abs / total.compared : 0.0) << endl;
+    cout << "Max ULP: " << total.max_ulp << endl;
+    cout << "Mismatches: " << total.mismatches << endl;
+    cout << (total.mismatches == 0 ? "PASSED" : "FAILED") << endl;
+
+    return total.mismatches == 0 ? 0 : 1;
+}
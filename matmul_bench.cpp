@@ -0,0 +1,269 @@
+/*
+ * University of Antioquia - Operating Systems Course
+ * Practice #3 - Matrix Multiplication Using Processes
+ *
+ * matmul_bench: load generator for the matrix_mul daemon.
+ *
+ * Several client threads, each with its own connection, keep a fixed number of
+ * jobs in flight until the requested number of jobs has been submitted. The
+ * latency of every job (from submit() to its result) is recorded and reported
+ * as percentiles, together with the throughput and the queueing and compute
+ * times measured by the daemon. The first result of every client is checked
+ * against a local multiplication.
+ *
+ * Exit status: 0 if every job succeeded, 1 otherwise.
+ */
+
+ #include <iostream>
+ #include <vector>
+ #include <string>
+ #include <thread>
+ #include <mutex>
+ #include <atomic>
+ #include <chrono>
+ #include <random>
+ #include <algorithm>
+ #include <cmath>
+ #include <getopt.h>
+ #include <iomanip>
+ #include "matmul_client.h"
+
+ using namespace std;
+
+// Results collected by one client thread
+struct ClientStats {
+    vector<double> latencies;   // seconds, successful jobs only
+    double queue_total = 0.0;
+    double compute_total = 0.0;
+    long rejected = 0;
+    long failed = 0;
+    bool checked = false;
+    bool check_passed = true;
+    string error;
+};
+
+const int DEFAULT_SIZE = 128;
+const long DEFAULT_JOBS = 200;
+const int DEFAULT_CLIENTS = 4;
+const int DEFAULT_OUTSTANDING = 1;
+
+// Function declarations
+bool checkProduct(const MatmulBuffer& A, const MatmulBuffer& B, const MatmulBuffer& C);
+void runClient(const string& socket_path, int size, atomic<long>& jobs_left, int outstanding, unsigned seed,
+               ClientStats& stats);
+double percentile(const vector<double>& sorted, double p);
+void printUsage(const char* programName);
+
+// Function to compare C with a local multiplication of A and B
+bool checkProduct(const MatmulBuffer& A, const MatmulBuffer& B, const MatmulBuffer& C) {
+    int N = A.rows();
+    int M = A.cols();
+    int P = B.cols();
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < P; j++) {
+            double sum = 0.0;
+            for (int k = 0; k < M; k++) {
+                sum += A.data()[(long)i * M + k] * B.data()[(long)k * P + j];
+            }
+            double got = C.data()[(long)i * P + j];
+            if (fabs(got - sum) > 1e-9 * max(1.0, fabs(sum))) return false;
+        }
+    }
+    return true;
+}
+
+// Function run by each client thread: keep `outstanding` jobs in flight until no jobs are left
+void runClient(const string& socket_path, int size, atomic<long>& jobs_left, int outstanding, unsigned seed,
+               ClientStats& stats) {
+    MatmulClient client;
+    if (!client.connect(socket_path)) {
+        stats.error = client.error();
+        return;
+    }
+
+    MatmulBuffer A, B;
+    vector<MatmulBuffer> C(outstanding);
+    if (!A.create(size, size) || !B.create(size, size)) {
+        stats.error = A.error().empty() ? B.error() : A.error();
+        return;
+    }
+    for (MatmulBuffer& buffer : C) {
+        if (!buffer.create(size, size)) {
+            stats.error = buffer.error();
+            return;
+        }
+    }
+
+    mt19937 gen(seed);
+    uniform_real_distribution<double> dist(-1.0, 1.0);
+    for (long i = 0; i < (long)size * size; i++) {
+        A.data()[i] = dist(gen);
+        B.data()[i] = dist(gen);
+    }
+    if (!A.seal() || !B.seal()) {
+        stats.error = A.error().empty() ? B.error() : A.error();
+        return;
+    }
+
+    // The job id is the index of its C buffer
+    vector<chrono::steady_clock::time_point> submitted(outstanding);
+    int in_flight = 0;
+    auto submitNext = [&](int slot) {
+        if (jobs_left.fetch_sub(1) <= 0) return true;
+        submitted[slot] = chrono::steady_clock::now();
+        if (!client.submit(slot, A, B, C[slot])) {
+            stats.error = client.error();
+            return false;
+        }
+        in_flight++;
+        return true;
+    };
+
+    for (int slot = 0; slot < outstanding; slot++) {
+        if (!submitNext(slot)) return;
+    }
+
+    while (in_flight > 0) {
+        MatmulJobResult result;
+        if (!client.waitResult(result)) {
+            stats.error = client.error();
+            return;
+        }
+        in_flight--;
+        int slot = result.job_id;
+        if (slot < 0 || slot >= outstanding) {
+            stats.error = "Error: Unexpected job id in result";
+            return;
+        }
+        double latency = chrono::duration<double>(chrono::steady_clock::now() - submitted[slot]).count();
+
+        if (result.status == MATMUL_OK) {
+            stats.latencies.push_back(latency);
+            stats.queue_total += result.queue_seconds;
+            stats.compute_total += result.compute_seconds;
+            if (!stats.checked) {
+                stats.checked = true;
+                stats.check_passed = checkProduct(A, B, C[slot]);
+            }
+        } else if (result.status == MATMUL_REJECTED) {
+            stats.rejected++;
+        } else {
+            stats.failed++;
+        }
+
+        if (!submitNext(slot)) return;
+    }
+}
+
+// Function to get a percentile of sorted values, interpolating between neighbours
+double percentile(const vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    double pos = p / 100.0 * (sorted.size() - 1);
+    size_t lower = (size_t)pos;
+    size_t upper = min(lower + 1, sorted.size() - 1);
+    return sorted[lower] + (pos - lower) * (sorted[upper] - sorted[lower]);
+}
+
+void printUsage(const char* programName) {
+    cout << "Usage: " << programName << " <socket> [options]" << endl;
+    cout << "Options:" << endl;
+    cout << "  --size <n>           Multiply n x n matrices (default: " << DEFAULT_SIZE << ")" << endl;
+    cout << "  --jobs <k>           Total number of jobs (default: " << DEFAULT_JOBS << ")" << endl;
+    cout << "  -c <clients>         Client connections, one thread each (default: " << DEFAULT_CLIENTS << ")" << endl;
+    cout << "  --outstanding <o>    Jobs in flight per connection (default: " << DEFAULT_OUTSTANDING << ")" << endl;
+    cout << endl;
+    cout << "Exit status: 0 if every job succeeded, 1 otherwise." << endl;
+    cout << endl;
+    cout << "Examples:" << endl;
+    cout << "  " << programName << " /tmp/matrix_mul.sock --size 256 --jobs 1000 -c 8" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    string socket_path = argv[1];
+    int size = DEFAULT_SIZE;
+    long total_jobs = DEFAULT_JOBS;
+    int num_clients = DEFAULT_CLIENTS;
+    int outstanding = DEFAULT_OUTSTANDING;
+
+    static struct option long_options[] = {
+        {"size", required_argument, 0, 's'},
+        {"jobs", required_argument, 0, 'j'},
+        {"outstanding", required_argument, 0, 'o'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc - 1, argv + 1, "c:", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 's':
+                size = atoi(optarg);
+                break;
+            case 'j':
+                total_jobs = atol(optarg);
+                break;
+            case 'c':
+                num_clients = atoi(optarg);
+                break;
+            case 'o':
+                outstanding = atoi(optarg);
+                break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+    if (size <= 0 || total_jobs <= 0 || num_clients <= 0 || outstanding <= 0) {
+        cerr << "Error: Size, jobs, clients and outstanding jobs must be positive" << endl;
+        return 1;
+    }
+
+    atomic<long> jobs_left(total_jobs);
+    vector<ClientStats> stats(num_clients);
+    vector<thread> threads;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < num_clients; i++) {
+        threads.emplace_back(runClient, socket_path, size, ref(jobs_left), outstanding, 1234u + i, ref(stats[i]));
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<double> latencies;
+    double queue_total = 0.0, compute_total = 0.0;
+    long rejected = 0, failed = 0;
+    bool errors = false, check_passed = true;
+    for (const ClientStats& s : stats) {
+        if (!s.error.empty()) {
+            cerr << s.error << endl;
+            errors = true;
+        }
+        latencies.insert(latencies.end(), s.latencies.begin(), s.latencies.end());
+        queue_total += s.queue_total;
+        compute_total += s.compute_total;
+        rejected += s.rejected;
+        failed += s.failed;
+        check_passed = check_passed && s.check_passed;
+    }
+    sort(latencies.begin(), latencies.end());
+    long completed = latencies.size();
+
+    cout << fixed << setprecision(3);
+    cout << "Jobs: " << completed << " completed, " << rejected << " rejected, " << failed << " failed ("
+         << size << "x" << size << ", " << num_clients << " clients, " << outstanding << " outstanding each)" << endl;
+    cout << "Throughput: " << completed / elapsed << " jobs/s over " << elapsed << " seconds" << endl;
+    if (completed > 0) {
+        cout << "Latency (ms): p50 " << percentile(latencies, 50) * 1e3 << ", p90 " << percentile(latencies, 90) * 1e3
+             << ", p99 " << percentile(latencies, 99) * 1e3 << ", max " << latencies.back() * 1e3 << endl;
+        cout << "Daemon time (ms, mean): queue " << queue_total / completed * 1e3 << ", compute "
+             << compute_total / completed * 1e3 << endl;
+    }
+    cout << "Check: " << (check_passed ? "PASSED" : "FAILED") << endl;
+
+    return errors || failed > 0 || !check_passed ? 1 : 0;
+}
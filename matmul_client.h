@@ -0,0 +1,324 @@
+/*
+ * University of Antioquia - Operating Systems Course
+ * Practice #3 - Matrix Multiplication Using Processes
+ *
+ * Client library for the matrix_mul daemon (matrix_mul --daemon <socket>).
+ *
+ * Matrices are exchanged through memfd buffers laid out like the shared memory
+ * segments of matrix_mul: a MatmulMatrixHeader followed by the values in
+ * row-major order. A job sends the descriptors of A, B and C over a Unix
+ * domain socket (SCM_RIGHTS), so no matrix data is copied: the daemon's
+ * workers map the same pages and write the product directly into C.
+ *
+ * The daemon only accepts sealed buffers: every buffer is sealed against
+ * resizing when it is created, and A and B must also be sealed against writes
+ * with MatmulBuffer::seal() once they are filled. This way a client cannot
+ * change the inputs or truncate a buffer while the daemon's workers use it.
+ *
+ * Jobs are asynchronous. submit() returns as soon as the request is sent and
+ * results arrive later, in completion order, tagged with the job id chosen by
+ * the client. Several jobs may be outstanding on one connection.
+ */
+
+#ifndef MATMUL_CLIENT_H
+#define MATMUL_CLIENT_H
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+const uint32_t MATMUL_PROTOCOL_MAGIC = 0x4c554d4d;  // "MMUL"
+const uint32_t MATMUL_PROTOCOL_VERSION = 1;
+
+// Layout of the start of every matrix buffer (same as SharedMatrixData)
+struct MatmulMatrixHeader {
+    int n_rows;
+    int n_cols;
+};
+
+enum MatmulJobStatus : int32_t {
+    MATMUL_OK = 0,
+    MATMUL_REJECTED = 1,  // admission control: the daemon queue is full
+    MATMUL_INVALID = 2,   // bad descriptors or dimensions
+    MATMUL_FAILED = 3     // a worker failed while computing the job
+};
+
+// Sent with exactly three descriptors: A, B and C, in that order
+struct MatmulJobRequest {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t job_id;
+};
+
+struct MatmulJobResult {
+    uint64_t job_id;
+    int32_t status;
+    int32_t reserved;
+    double queue_seconds;    // from arrival at the daemon until the first worker started
+    double compute_seconds;  // from the first worker start until the last worker finished
+};
+
+// Function to send a message with up to max_fds descriptors attached. Returns false on failure.
+inline bool matmulSendMessage(int sock, const void* msg, size_t len, const int* fds, int n_fds) {
+    const int max_fds = 4;
+    if (n_fds > max_fds) return false;
+
+    iovec iov;
+    iov.iov_base = const_cast<void*>(msg);
+    iov.iov_len = len;
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * max_fds)];
+    msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    if (n_fds > 0) {
+        memset(control, 0, sizeof(control));
+        hdr.msg_control = control;
+        hdr.msg_controllen = CMSG_SPACE(sizeof(int) * n_fds);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n_fds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * n_fds);
+    }
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(sock, &hdr, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    return sent == (ssize_t)len;
+}
+
+// Function to receive one message and the descriptors attached to it. Returns
+// the message size, 0 when the peer closed the connection or -1 on error.
+// Descriptors beyond max_fds are closed.
+inline ssize_t matmulRecvMessage(int sock, void* msg, size_t len, int* fds, int max_fds, int& n_fds) {
+    iovec iov;
+    iov.iov_base = msg;
+    iov.iov_len = len;
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * 8)];
+    msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof(control);
+
+    ssize_t got;
+    do {
+        got = recvmsg(sock, &hdr, MSG_CMSG_CLOEXEC);
+    } while (got < 0 && errno == EINTR);
+
+    n_fds = 0;
+    if (got < 0) return -1;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+        int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const unsigned char* data = CMSG_DATA(cmsg);
+        for (int i = 0; i < count; i++) {
+            int fd;
+            memcpy(&fd, data + i * sizeof(int), sizeof(int));
+            if (n_fds < max_fds) {
+                fds[n_fds++] = fd;
+            } else {
+                close(fd);
+            }
+        }
+    }
+    return got;
+}
+
+// A matrix in an anonymous memfd, ready to be passed to the daemon
+class MatmulBuffer {
+public:
+    MatmulBuffer() = default;
+    MatmulBuffer(const MatmulBuffer&) = delete;
+    MatmulBuffer& operator=(const MatmulBuffer&) = delete;
+    ~MatmulBuffer() { release(); }
+
+    // Creates a rows x cols buffer filled with zeros, sealed against resizing.
+    // Returns false and sets error() on failure.
+    bool create(int rows, int cols) {
+        release();
+        size_ = sizeof(MatmulMatrixHeader) + (size_t)rows * cols * sizeof(double);
+        fd_ = memfd_create("matmul", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (fd_ == -1) {
+            error_ = std::string("Error creating memfd: ") + strerror(errno);
+            return false;
+        }
+        if (ftruncate(fd_, size_) == -1 || fcntl(fd_, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) == -1) {
+            error_ = std::string("Error setting size of memfd: ") + strerror(errno);
+            release();
+            return false;
+        }
+        void* ptr = mmap(0, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (ptr == MAP_FAILED) {
+            error_ = std::string("Error mapping memfd: ") + strerror(errno);
+            release();
+            return false;
+        }
+        header_ = static_cast<MatmulMatrixHeader*>(ptr);
+        header_->n_rows = rows;
+        header_->n_cols = cols;
+        return true;
+    }
+
+    // Makes an input buffer immutable (F_SEAL_WRITE), as the daemon requires for
+    // A and B. The mapping becomes read-only: data() must not be written afterwards.
+    bool seal() {
+        if (sealed_) return true;
+        // Writable shared mappings must be gone before the write seal can be added
+        munmap(header_, size_);
+        header_ = nullptr;
+        bool ok = fcntl(fd_, F_ADD_SEALS, F_SEAL_WRITE) == 0;
+        if (!ok) {
+            error_ = std::string("Error sealing memfd: ") + strerror(errno);
+        }
+        void* ptr = mmap(0, size_, ok ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (ptr == MAP_FAILED) {
+            error_ = std::string("Error mapping memfd: ") + strerror(errno);
+            release();
+            return false;
+        }
+        header_ = static_cast<MatmulMatrixHeader*>(ptr);
+        sealed_ = ok;
+        return ok;
+    }
+
+    void release() {
+        sealed_ = false;
+        if (header_ != nullptr) {
+            munmap(header_, size_);
+            header_ = nullptr;
+        }
+        if (fd_ != -1) {
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    int fd() const { return fd_; }
+    bool sealed() const { return sealed_; }
+    int rows() const { return header_->n_rows; }
+    int cols() const { return header_->n_cols; }
+    double* data() { return reinterpret_cast<double*>(header_ + 1); }
+    const double* data() const { return reinterpret_cast<const double*>(header_ + 1); }
+    double& at(int row, int col) { return data()[(long)row * header_->n_cols + col]; }
+    const std::string& error() const { return error_; }
+
+private:
+    int fd_ = -1;
+    MatmulMatrixHeader* header_ = nullptr;
+    size_t size_ = 0;
+    bool sealed_ = false;
+    std::string error_;
+};
+
+// One connection to the daemon
+class MatmulClient {
+public:
+    MatmulClient() = default;
+    MatmulClient(const MatmulClient&) = delete;
+    MatmulClient& operator=(const MatmulClient&) = delete;
+    ~MatmulClient() { disconnect(); }
+
+    // Connects to the daemon socket. Returns false and sets error() on failure.
+    bool connect(const std::string& socket_path) {
+        disconnect();
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(addr.sun_path)) {
+            error_ = "Error: Socket path too long: " + socket_path;
+            return false;
+        }
+        strcpy(addr.sun_path, socket_path.c_str());
+
+        sock_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (sock_ == -1) {
+            error_ = std::string("Error creating socket: ") + strerror(errno);
+            return false;
+        }
+        if (::connect(sock_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+            error_ = "Error connecting to " + socket_path + ": " + strerror(errno);
+            disconnect();
+            return false;
+        }
+        return true;
+    }
+
+    void disconnect() {
+        if (sock_ != -1) {
+            close(sock_);
+            sock_ = -1;
+        }
+    }
+
+    // Descriptor to poll for readability when several jobs are outstanding
+    int fd() const { return sock_; }
+
+    // Sends C = A * B as job job_id. A and B must be sealed. The buffers must
+    // stay alive until its result arrives.
+    bool submit(uint64_t job_id, const MatmulBuffer& A, const MatmulBuffer& B, MatmulBuffer& C) {
+        if (!A.sealed() || !B.sealed()) {
+            error_ = "Error: A and B must be sealed with MatmulBuffer::seal() before they are submitted";
+            return false;
+        }
+        MatmulJobRequest request;
+        request.magic = MATMUL_PROTOCOL_MAGIC;
+        request.version = MATMUL_PROTOCOL_VERSION;
+        request.job_id = job_id;
+        int fds[3] = {A.fd(), B.fd(), C.fd()};
+        if (!matmulSendMessage(sock_, &request, sizeof(request), fds, 3)) {
+            error_ = std::string("Error sending job: ") + strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    // Blocks until the next job finishes. Returns false and sets error() if the connection failed.
+    bool waitResult(MatmulJobResult& result) {
+        int n_fds;
+        ssize_t got = matmulRecvMessage(sock_, &result, sizeof(result), nullptr, 0, n_fds);
+        if (got != (ssize_t)sizeof(result)) {
+            error_ = got == 0 ? "Error: The daemon closed the connection"
+                              : std::string("Error receiving result: ") + strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    // Submits one job and waits for its result
+    bool multiply(uint64_t job_id, const MatmulBuffer& A, const MatmulBuffer& B, MatmulBuffer& C,
+                  MatmulJobResult& result) {
+        return submit(job_id, A, B, C) && waitResult(result);
+    }
+
+    const std::string& error() const { return error_; }
+
+private:
+    int sock_ = -1;
+    std::string error_;
+};
+
+// Function to describe a job status
+inline const char* matmulStatusName(int32_t status) {
+    switch (status) {
+        case MATMUL_OK: return "ok";
+        case MATMUL_REJECTED: return "rejected";
+        case MATMUL_INVALID: return "invalid";
+        case MATMUL_FAILED: return "failed";
+    }
+    return "unknown";
+}
+
+#endif // MATMUL_CLIENT_H
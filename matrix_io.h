@@ -0,0 +1,399 @@
+/*
+ * University of Antioquia - Operating Systems Course
+ * Practice #3 - Matrix Multiplication Using Processes
+ *
+ * Matrix file I/O shared by matrix_mul and matdiff.
+ *
+ * Two on-disk formats are supported:
+ *  - Text: one row per line, values separated by whitespace. Empty lines are
+ *    ignored.
+ *  - Binary: a BinaryMatrixHeader followed by rows * cols doubles in row-major
+ *    order (native byte order).
+ * Readers detect the format from the first bytes of the file.
+ */
+
+#ifndef MATRIX_IO_H
+#define MATRIX_IO_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <charconv>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+const char BINARY_MATRIX_MAGIC[8] = {'M', 'A', 'T', 'B', 'I', 'N', '0', '1'};
+
+struct BinaryMatrixHeader {
+    char magic[8];
+    int64_t n_rows;
+    int64_t n_cols;
+};
+
+// Reads a matrix file a few rows at a time, so that arbitrarily large files
+// can be processed in bounded memory. Text is read in large chunks and parsed
+// with std::from_chars, which is much faster than iostream extraction.
+class MatrixStreamReader {
+public:
+    static const size_t CHUNK_SIZE = 1 << 20;
+
+    MatrixStreamReader() = default;
+    MatrixStreamReader(const MatrixStreamReader&) = delete;
+    MatrixStreamReader& operator=(const MatrixStreamReader&) = delete;
+    ~MatrixStreamReader() { close(); }
+
+    // Opens the file and detects its format. Returns false and sets error() on failure.
+    bool open(const std::string& filename) {
+        close();
+        file_ = fopen(filename.c_str(), "rb");
+        if (file_ == nullptr) {
+            error_ = "Error opening file: " + filename + " (" + strerror(errno) + ")";
+            return false;
+        }
+
+        BinaryMatrixHeader header;
+        size_t got = fread(&header, 1, sizeof(header), file_);
+        if (got == sizeof(header) && memcmp(header.magic, BINARY_MATRIX_MAGIC, sizeof(header.magic)) == 0) {
+            binary_ = true;
+            total_rows_ = header.n_rows;
+            cols_ = header.n_cols;
+            if (total_rows_ <= 0 || cols_ <= 0) {
+                error_ = "Error: Invalid binary matrix header in " + filename;
+                return false;
+            }
+
+            // The dimensions must account for exactly the rest of the file,
+            // so that a corrupt header cannot cause a huge allocation
+            struct stat st;
+            if (fstat(fileno(file_), &st) == -1) {
+                error_ = "Error reading size of file: " + filename + " (" + strerror(errno) + ")";
+                return false;
+            }
+            uint64_t data_bytes = (uint64_t)st.st_size - sizeof(header);
+            if ((uint64_t)total_rows_ > data_bytes / sizeof(double) / (uint64_t)cols_ ||
+                (uint64_t)total_rows_ * (uint64_t)cols_ * sizeof(double) != data_bytes) {
+                error_ = "Error: Binary matrix header of " + filename + " (" + std::to_string(total_rows_) + "x" +
+                         std::to_string(cols_) + ") does not match the file size (" + std::to_string(st.st_size) +
+                         " bytes)";
+                return false;
+            }
+            return true;
+        }
+
+        // Not binary: keep whatever was read as the start of the text buffer
+        binary_ = false;
+        buffer_.assign(reinterpret_cast<char*>(&header), got);
+        pos_ = 0;
+        return true;
+    }
+
+    void close() {
+        if (file_ != nullptr) {
+            fclose(file_);
+            file_ = nullptr;
+        }
+        buffer_.clear();
+        pos_ = 0;
+        eof_ = false;
+        rows_read_ = 0;
+        total_rows_ = -1;
+        cols_ = -1;
+    }
+
+    bool isBinary() const { return binary_; }
+
+    // Number of columns, or -1 while unknown (text files before the first row)
+    long cols() const { return cols_; }
+
+    // Total number of rows, or -1 when unknown (text files)
+    long totalRows() const { return total_rows_; }
+
+    long rowsRead() const { return rows_read_; }
+
+    const std::string& error() const { return error_; }
+
+    // Appends up to max_rows rows to out (row-major) and returns how many were
+    // read. Returns 0 at end of file and -1 on error.
+    long readRows(std::vector<double>& out, long max_rows) {
+        if (file_ == nullptr) {
+            error_ = "Error: Matrix file is not open";
+            return -1;
+        }
+        return binary_ ? readBinaryRows(out, max_rows) : readTextRows(out, max_rows);
+    }
+
+    // Skips up to n rows without converting their values: a seek in binary
+    // files, a scan for the ends of the non-empty lines in text files. Returns
+    // the number of rows skipped, or -1 on error.
+    long skipRows(long n) {
+        if (file_ == nullptr) {
+            error_ = "Error: Matrix file is not open";
+            return -1;
+        }
+        if (binary_) {
+            n = std::max(0L, std::min(n, total_rows_ - rows_read_));
+            if (!seekBinaryRow(rows_read_ + n, 0)) return -1;
+            rows_read_ += n;
+            return n;
+        }
+
+        long skipped = 0;
+        while (skipped < n) {
+            if (pos_ >= buffer_.size() && eof_) break;
+            size_t line_end = fillLine();
+            if (pos_ >= line_end && eof_ && line_end == buffer_.size()) break;
+            bool has_data = false;
+            for (size_t i = pos_; i < line_end && !has_data; i++) {
+                char c = buffer_[i];
+                has_data = c != ' ' && c != '\t' && c != '\r';
+            }
+            pos_ = line_end < buffer_.size() ? line_end + 1 : line_end;
+            skipped += has_data;
+        }
+        rows_read_ += skipped;
+        return skipped;
+    }
+
+    // Appends columns [col_begin, col_end) of up to max_rows rows to out and
+    // returns how many rows were read (0 at end of file, -1 on error). Binary
+    // files are read at direct offsets, so only the requested block is read.
+    long readColumns(std::vector<double>& out, long max_rows, long col_begin, long col_end) {
+        if (file_ == nullptr) {
+            error_ = "Error: Matrix file is not open";
+            return -1;
+        }
+        if (!binary_) {
+            std::vector<double> row;
+            long n = 0;
+            for (; n < max_rows; n++) {
+                row.clear();
+                long got = readTextRows(row, 1);
+                if (got < 0) return -1;
+                if (got == 0) break;
+                if (col_begin < 0 || col_end > cols_ || col_begin > col_end) {
+                    error_ = "Error: Column range out of bounds in row " + std::to_string(rows_read_ - 1);
+                    return -1;
+                }
+                out.insert(out.end(), row.begin() + col_begin, row.begin() + col_end);
+            }
+            return n;
+        }
+
+        if (col_begin < 0 || col_end > cols_ || col_begin > col_end) {
+            error_ = "Error: Column range out of bounds";
+            return -1;
+        }
+        long n = std::min(max_rows, total_rows_ - rows_read_);
+        if (n <= 0) return 0;
+        long width = col_end - col_begin;
+        size_t old_size = out.size();
+        out.resize(old_size + n * width);
+        for (long i = 0; i < n; i++) {
+            if (!seekBinaryRow(rows_read_ + i, col_begin) ||
+                fread(out.data() + old_size + i * width, sizeof(double), width, file_) != (size_t)width) {
+                out.resize(old_size);
+                if (error_.empty()) error_ = "Error: Unexpected end of binary matrix data";
+                return -1;
+            }
+        }
+        rows_read_ += n;
+        if (!seekBinaryRow(rows_read_, 0)) {
+            out.resize(old_size);
+            return -1;
+        }
+        return n;
+    }
+
+private:
+    // Positions a binary file at column col of row
+    bool seekBinaryRow(long row, long col) {
+        off_t offset = (off_t)sizeof(BinaryMatrixHeader) + ((off_t)row * cols_ + col) * (off_t)sizeof(double);
+        if (fseeko(file_, offset, SEEK_SET) != 0) {
+            error_ = std::string("Error: Could not seek in binary matrix data (") + strerror(errno) + ")";
+            return false;
+        }
+        return true;
+    }
+
+    long readBinaryRows(std::vector<double>& out, long max_rows) {
+        long n = std::min(max_rows, total_rows_ - rows_read_);
+        if (n <= 0) return 0;
+
+        size_t old_size = out.size();
+        out.resize(old_size + n * cols_);
+        size_t got = fread(out.data() + old_size, sizeof(double), n * cols_, file_);
+        if (got != (size_t)(n * cols_)) {
+            out.resize(old_size);
+            error_ = "Error: Unexpected end of binary matrix data";
+            return -1;
+        }
+        rows_read_ += n;
+        return n;
+    }
+
+    // Makes sure buffer_ holds a complete line starting at pos_ (or the rest
+    // of the file). Returns the end of that line.
+    size_t fillLine() {
+        for (;;) {
+            const char* start = buffer_.data() + pos_;
+            const void* nl = memchr(start, '\n', buffer_.size() - pos_);
+            if (nl != nullptr) return static_cast<const char*>(nl) - buffer_.data();
+            if (eof_) return buffer_.size();
+
+            // Drop consumed bytes and append the next chunk
+            buffer_.erase(0, pos_);
+            pos_ = 0;
+            size_t old_size = buffer_.size();
+            buffer_.resize(old_size + CHUNK_SIZE);
+            size_t got = fread(&buffer_[old_size], 1, CHUNK_SIZE, file_);
+            buffer_.resize(old_size + got);
+            if (got < CHUNK_SIZE) eof_ = true;
+        }
+    }
+
+    long readTextRows(std::vector<double>& out, long max_rows) {
+        long n = 0;
+        while (n < max_rows) {
+            if (pos_ >= buffer_.size() && eof_) break;
+            size_t line_end = fillLine();
+            if (pos_ >= line_end && eof_ && line_end == buffer_.size()) break;
+
+            const char* p = buffer_.data() + pos_;
+            const char* end = buffer_.data() + line_end;
+            size_t old_size = out.size();
+            long values = 0;
+
+            // Parse values from the current line
+            for (;;) {
+                while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+                if (p == end) break;
+                double value;
+                if (*p == '+') p++;  // from_chars does not accept a leading '+'
+                std::from_chars_result res = std::from_chars(p, end, value);
+                if (res.ec != std::errc()) {
+                    error_ = "Error: Invalid number in row " + std::to_string(rows_read_ + n);
+                    out.resize(old_size);
+                    return -1;
+                }
+                out.push_back(value);
+                values++;
+                p = res.ptr;
+            }
+            pos_ = line_end < buffer_.size() ? line_end + 1 : line_end;
+
+            // Only count non-empty rows
+            if (values == 0) continue;
+            if (cols_ < 0) {
+                cols_ = values;
+            } else if (values != cols_) {
+                error_ = "Error: Inconsistent number of columns in row " + std::to_string(rows_read_ + n);
+                out.resize(old_size);
+                return -1;
+            }
+            n++;
+        }
+        rows_read_ += n;
+        return n;
+    }
+
+    FILE* file_ = nullptr;
+    bool binary_ = false;
+    bool eof_ = false;
+    std::string buffer_;
+    size_t pos_ = 0;
+    long rows_read_ = 0;
+    long total_rows_ = -1;
+    long cols_ = -1;
+    std::string error_;
+};
+
+// Function to get the shape of a matrix file without parsing all of it: the
+// header of a binary file, or the first row plus a count of the non-empty
+// lines of a text file. Returns false and sets error on failure.
+inline bool peekMatrixShape(const std::string& filename, long& rows, long& cols, std::string& error) {
+    MatrixStreamReader reader;
+    if (!reader.open(filename)) {
+        error = reader.error();
+        return false;
+    }
+    if (reader.isBinary()) {
+        rows = reader.totalRows();
+        cols = reader.cols();
+        return true;
+    }
+
+    std::vector<double> first_row;
+    if (reader.readRows(first_row, 1) != 1) {
+        error = reader.error().empty() ? "Error: Empty matrix file or no valid data" : reader.error();
+        return false;
+    }
+    cols = reader.cols();
+    reader.close();
+
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (file == nullptr) {
+        error = "Error opening file: " + filename + " (" + strerror(errno) + ")";
+        return false;
+    }
+    std::vector<char> chunk(MatrixStreamReader::CHUNK_SIZE);
+    bool line_has_data = false;
+    rows = 0;
+    size_t got;
+    while ((got = fread(chunk.data(), 1, chunk.size(), file)) > 0) {
+        for (size_t i = 0; i < got; i++) {
+            char c = chunk[i];
+            if (c == '\n') {
+                rows += line_has_data;
+                line_has_data = false;
+            } else if (c != ' ' && c != '\t' && c != '\r') {
+                line_has_data = true;
+            }
+        }
+    }
+    rows += line_has_data;
+    fclose(file);
+    return true;
+}
+
+// Function to write a row-major matrix in binary format. Returns false on failure.
+inline bool writeBinaryMatrix(const std::string& filename, long rows, long cols, const double* data) {
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (file == nullptr) return false;
+
+    BinaryMatrixHeader header;
+    memcpy(header.magic, BINARY_MATRIX_MAGIC, sizeof(header.magic));
+    header.n_rows = rows;
+    header.n_cols = cols;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(data, sizeof(double), rows * cols, file) == (size_t)(rows * cols);
+    return fclose(file) == 0 && ok;
+}
+
+// Function to write a nested-vector matrix in binary format. Returns false on failure.
+inline bool writeBinaryMatrix(const std::string& filename, const std::vector<std::vector<double>>& matrix) {
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (file == nullptr) return false;
+
+    BinaryMatrixHeader header;
+    memcpy(header.magic, BINARY_MATRIX_MAGIC, sizeof(header.magic));
+    header.n_rows = matrix.size();
+    header.n_cols = matrix.empty() ? 0 : matrix[0].size();
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (size_t i = 0; ok && i < matrix.size(); i++) {
+        ok = fwrite(matrix[i].data(), sizeof(double), header.n_cols, file) == (size_t)header.n_cols;
+    }
+    return fclose(file) == 0 && ok;
+}
+
+// Function to check whether a file name asks for the binary format
+inline bool isBinaryMatrixFilename(const std::string& filename) {
+    return filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".bin") == 0;
+}
+
+#endif // MATRIX_IO_H
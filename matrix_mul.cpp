@@ -26,6 +26,37 @@
  #include <iomanip>
  #include <limits>
  #include <filesystem>
+ #include <atomic>
+ #include <cstdint>
+ #include <ctime>
+ #include <cmath>
+ #include <random>
+ #include <map>
+ #include <cstdlib>
+ #include <sys/file.h>
+ #include <sys/resource.h>
+ #include <sys/syscall.h>
+ #include <sys/prctl.h>
+ #include <sched.h>
+ #include <linux/futex.h>
+ #include <climits>
+ #include <new>
+ #include <deque>
+ #include <csignal>
+ #include <poll.h>
+ #include <sys/socket.h>
+ #include <sys/un.h>
+ #include <netdb.h>
+ #include <netinet/in.h>
+ #include <netinet/tcp.h>
+ #include <arpa/inet.h>
+ #include <thread>
+ #include <mutex>
+ #include <condition_variable>
+#include <endian.h>
+ #include "matrix_io.h"
+ #include "xxhash64.h"
+ #include "matmul_client.h"
 
  namespace fs = std::filesystem;
 
@@ -38,57 +69,607 @@ struct SharedMatrixData {
     // The actual matrix data will be stored after this struct in memory
 };
 
+// Phases recorded in the execution trace (--trace)
+enum TracePhase : uint8_t {
+    PHASE_READ_A,
+    PHASE_READ_B,
+    PHASE_SEQUENTIAL,
+    PHASE_PARALLEL,
+    PHASE_SHM_SETUP,
+    PHASE_SPAWN,
+    PHASE_WAIT,
+    PHASE_EXTRACT,
+    PHASE_WRITE,
+    PHASE_WORKER,
+    PHASE_ROW_BLOCK,
+    PHASE_VERIFY,
+    PHASE_TUNE,
+    PHASE_HASH,
+    PHASE_CACHE,
+    PHASE_DELTA,
+    PHASE_PANEL_WAIT
+};
+
+const char* const TRACE_PHASE_NAMES[] = {
+    "read_A", "read_B", "sequential", "parallel", "shm_setup",
+    "spawn", "wait", "extract", "write", "worker", "row_block", "verify", "tune", "hash", "cache", "delta", "panel_wait"
+};
+
+// A single begin/end event. arg0/arg1 carry the row range for row blocks.
+struct TraceEvent {
+    uint64_t ts_ns;
+    int32_t arg0;
+    int32_t arg1;
+    uint8_t phase;
+    char type;  // 'B' or 'E'
+};
+
+const size_t TRACE_RING_CAPACITY = 8192;
+
+// Per-process ring buffer. Each ring has exactly one writer (its owning
+// process), so publishing an event is a plain store followed by a release
+// increment of head; no locks are involved. When full, the oldest events are
+// overwritten.
+struct TraceRing {
+    atomic<uint64_t> head;
+    int32_t pid;
+    int32_t worker;
+    TraceEvent events[TRACE_RING_CAPACITY];
+};
+
+// Shared memory layout of the trace segment: header followed by n_rings rings.
+// Ring 0 belongs to the parent, ring i + 1 to worker i.
+struct TraceBuffer {
+    int n_rings;
+    uint64_t start_ns;
+    // The rings will be stored after this struct in memory
+};
+
+// Minimum amount of multiply-adds per traced row block. Recording an event
+// takes about 50 ns (measured in a loop of 2 million events), so the two
+// events of a block cost well under 0.1% of its compute time.
+const long TRACE_MIN_BLOCK_WORK = 1L << 20;
+
+// Kernels available to the workers
+enum KernelType {
+    KERNEL_NAIVE,   // dot product per element, strided access to B
+    KERNEL_IKJ,     // row of C accumulated from rows of B, unit stride
+    KERNEL_TILED    // ikj over cache-sized tiles of A, B and C
+};
+
+const char* const KERNEL_NAMES[] = {"naive", "ikj", "tiled"};
+
+// Kernel selection and tile sizes used by calculateMatrixPortion
+struct KernelConfig {
+    KernelType kernel = KERNEL_NAIVE;
+    int tile_rows = 16;
+    int tile_cols = 256;
+    int tile_depth = 128;
+    bool trans_a = false;   // A is stored transposed (--transA)
+    bool trans_b = false;   // B is stored transposed (--transB)
+};
+
+// A tuned configuration for one host and shape class (see --tune)
+struct TuningEntry {
+    string host;
+    string shape_class;
+    int num_processes;
+    KernelConfig config;
+    double seconds;
+};
+
+// -n auto is stored as this value until it is resolved
+const int AUTO_PROCESSES = 0;
+// Upper bound for automatically chosen process counts
+const int MAX_AUTO_PROCESSES = 256;
+// Approximate multiply-adds per tuning measurement, and repetitions per candidate
+const long TUNE_PROBE_WORK = 1L << 25;
+const int TUNE_REPEATS = 3;
+
+// Control block of a tuning measurement. The workers are created first and
+// wait on round (a futex); the parent starts the clock when every worker is
+// waiting and releases the round, and each worker records when its rows are
+// done, so that only the kernel is timed. On failure round is set to
+// TUNE_ABORTED.
+struct SharedTuneData {
+    atomic<int> waiting;        // workers that reached a round, over all rounds
+    atomic<int> round;          // rounds released by the parent
+    int rounds;
+    uint64_t end_ns[TUNE_REPEATS][MAX_AUTO_PROCESSES];
+};
+
+const int TUNE_ABORTED = INT_MAX;
+
+// A row of C to produce in delta mode: recomputed from scratch, or updated
+// from the previous C with the rows of B that changed
+struct DeltaTask {
+    int row;
+    int recompute;
+};
+
+// Shared memory layout of the delta segment: this header, then n_tasks
+// DeltaTask, then n_dB_rows row indices (int), then the n_dB_rows x P matrix
+// of differences B_new - B_old for those rows.
+struct SharedDeltaData {
+    int n_tasks;
+    int n_dB_rows;
+    int n_cols;
+};
+
+// Rows per hashed block when looking for changes between runs
+const int DELTA_BLOCK_ROWS = 64;
+
+// Rounding errors of C += A * dB accumulate across chained runs, so after this
+// many consecutive incremental updates C is recomputed from scratch. With
+// --verify, a residual above DELTA_REFRESH_RESIDUAL also triggers a full
+// recomputation (a correct product is around 1e-16).
+const int DELTA_MAX_UPDATES = 16;
+const double DELTA_REFRESH_RESIDUAL = 1e-13;
+
+// Summary of a delta run
+struct DeltaStats {
+    int changed_rows_A = 0;
+    int changed_rows_B = 0;
+    int updates = 0;        // consecutive incremental updates behind the new C
+    bool incremental = false;
+    string reason;
+};
+
+// Control block shared with the workers in pipelined mode (--pipeline). The
+// parent publishes how many rows of A are in shared memory; workers claim
+// panels of rows in order and wait on rows_ready (a futex) until their panel
+// has been parsed. On failure rows_ready is set to PIPELINE_ABORTED, so that
+// the futex word changes and no worker can miss the wakeup.
+struct SharedPipelineData {
+    atomic<int> rows_ready;
+    atomic<int> next_panel;
+    atomic<int> failed;
+    int panel_rows;
+    int n_rows;
+};
+
+const int PIPELINE_ABORTED = INT_MAX;
+
+// Panels per worker in pipelined mode: enough for the first panels to start
+// early and for the load to balance, few enough to keep synchronization cheap
+const int PIPELINE_PANELS_PER_WORKER = 8;
+
+// Summary of a pipelined run
+struct PipelineStats {
+    double parse_seconds = 0.0;
+    int panels = 0;
+    int panel_rows = 0;
+};
+
+// Degenerate shapes with a dedicated bandwidth-bound kernel
+enum FastPathShape {
+    SHAPE_GENERAL,
+    SHAPE_GEMV,     // P == 1: y = A * x
+    SHAPE_VECMAT,   // N == 1: c = a^T * B
+    SHAPE_OUTER     // M == 1: C = a * b^T (rank-1)
+};
+
+const char* const FAST_PATH_NAMES[] = {"general", "gemv", "vecmat", "outer"};
+
+// Rows of a row-major matrix with a fixed stride, indexed like an array of
+// row pointers. The fast path kernels take either, so workers walk the shared
+// segments in place and the inline path walks nested vectors in place.
+template <typename T>
+struct StridedRows {
+    T* base;
+    long stride;
+    T* operator[](long i) const { return base + i * stride; }
+};
+
+// Control block of a fast path run with workers, followed by one end
+// timestamp per worker. Workers wait on released (a futex) until all of them
+// have started, so the parent times only the kernels: from the release to the
+// last end timestamp. On failure released is set to FAST_PATH_ABORTED.
+struct SharedFastPathData {
+    atomic<int> waiting;        // workers waiting for the release
+    atomic<int> released;
+    int n_workers;
+    // The end timestamps will be stored after this struct in memory
+};
+
+const int FAST_PATH_ABORTED = -1;
+
+// Below this many bytes of A, B and C the fast paths run in the parent: at
+// memory bandwidth that is well under the cost of creating the workers
+const size_t FAST_PATH_INLINE_BYTES = 16L << 20;
+
+// Fast path multiplications of this run. A run can make several (delta
+// fallback and refresh), so traffic and time are summed over the calls.
+struct FastPathStats {
+    FastPathShape shape = SHAPE_GENERAL;
+    bool inline_run = false;
+    int workers = 0;
+    int calls = 0;
+    double bytes = 0.0;         // minimum traffic: A, B and C once per call
+    double seconds = 0.0;
+};
+
+// How worker processes are created (--spawn)
+enum SpawnStrategy {
+    SPAWN_FORK,     // fork(): copies the page tables of the parent
+    SPAWN_VFORK,    // vfork() + exec of this binary in worker mode: no page table copy
+    SPAWN_CLONE     // clone(CLONE_VM): shares only the address space, runs on its own stack
+};
+
+const char* const SPAWN_NAMES[] = {"fork", "vfork", "clone"};
+
+// What a worker process computes
+enum WorkerKind {
+    WORKER_ROWS,        // rows [start, end) of C (calculateMatrixPortion)
+    WORKER_DELTA,       // delta tasks [start, end) (calculateDeltaPortion)
+    WORKER_PIPELINE,    // panels claimed dynamically (calculatePipelinedPortion)
+    WORKER_FAST_PATH,   // rows, or columns for vecmat, of a degenerate shape (calculateFastPathPortion)
+    WORKER_SUMMA,       // rows [start, end) of a SUMMA rank's C block, every panel (calculateSummaPortion)
+    WORKER_TUNE         // rows [start, end) of a tuning sample, once per round (calculateTunedPortion)
+};
+
+struct WorkerTask {
+    WorkerKind kind;
+    int index;      // worker number within the run, also its trace ring
+    int start;
+    int end;
+    int slot = 0;   // position in the spawned group, set by spawnWorkers: stack and timestamp slot
+};
+
+// Shared memory segments a worker operates on. aux is the delta, pipeline, SUMMA, tuning or fast path
+// segment.
+struct WorkerSegments {
+    void* A;
+    void* B;
+    void* C;
+    void* aux;
+};
+
+// Arguments of a clone worker, stored at the lowest address of its stack slot.
+// scratch points past the stack, to the buffer reserved for the task.
+struct CloneWorker {
+    WorkerTask task;
+    WorkerSegments segments;
+    KernelConfig config;
+    TraceRing* trace_ring;
+    double* scratch;
+    size_t scratch_count;
+};
+
+// Spawn latencies of the last group of workers
+struct SpawnStats {
+    int workers = 0;
+    double child_mean_us = 0.0;
+    double child_max_us = 0.0;
+    double parent_mean_us = 0.0;
+};
+
+const size_t CLONE_STACK_SIZE = 256 * 1024;
+
+// Job accepted by the daemon (--daemon)
+struct DaemonJob {
+    int client;             // connection that submitted it, -1 once it disconnected
+    uint64_t job_id;        // id chosen by the client
+    int fds[3];             // A, B and C
+    int N, M, P;
+    int pending_tasks;      // row blocks not finished yet
+    bool started = false;
+    bool failed = false;
+    chrono::steady_clock::time_point arrived, started_at;
+};
+
+// Row block of a job sent to a pool worker, together with the job's descriptors.
+// The shape is the one validated by the daemon: the headers in the buffers stay
+// writable by the client, so workers never read them.
+struct DaemonTaskMessage {
+    int job;
+    int start_row;
+    int end_row;
+    int N, M, P;
+};
+
+struct DaemonTaskDone {
+    int job;
+    int32_t status;
+};
+
+struct DaemonWorker {
+    pid_t pid;
+    int sock;
+    int job;                // job of the task being computed, -1 when idle
+};
+
+struct DaemonStats {
+    long completed = 0;
+    long rejected = 0;
+    long invalid = 0;
+    long failed = 0;
+};
+
+// Default admission limits of the daemon: jobs computed at the same time and
+// jobs waiting for a slot. Jobs beyond both are rejected.
+const int DAEMON_DEFAULT_MAX_JOBS = 4;
+const int DAEMON_DEFAULT_MAX_QUEUE = 64;
+
+// Process grid of the distributed SUMMA mode (--summa)
+struct SummaGrid {
+    int rows = 0;
+    int cols = 0;
+    int rank = -1;          // -1: launch every rank on this host
+    vector<string> peers;   // host:port of every rank, in rank order
+};
+
+// Per-rank timings of SUMMA, gathered on rank 0
+struct SummaStats {
+    int steps = 0;
+    double read_seconds = 0.0;
+    double compute_seconds = 0.0;
+    double comm_seconds = 0.0;      // time spent sending and receiving panels
+    double wait_seconds = 0.0;      // time the multiplication waited for a panel
+    double total_seconds = 0.0;
+    long bytes_sent = 0;
+    long bytes_received = 0;
+};
+
+// Control block shared with the workers of a SUMMA rank, which live for the
+// whole multiplication. The parent copies each panel of A and B into one of
+// two shared slots and publishes it through steps_ready (a futex); every
+// worker adds its rows of A_panel * B_panel to the shared C block and counts
+// itself in steps_done, and the last one of a step wakes the parent. On
+// failure steps_ready is set to SUMMA_ABORTED.
+struct SharedSummaData {
+    atomic<int> steps_ready;
+    atomic<int> steps_done;     // worker steps completed, over all steps
+    int steps;
+    int n_workers;
+    int n_rows;                 // local C block
+    int n_cols;
+    int max_width;              // widest panel, size of a slot
+    int widths[2];              // width of the panel in each slot
+};
+
+const int SUMMA_ABORTED = INT_MAX;
+
+// Connection attempts to a lower rank, 100 ms apart
+const int SUMMA_CONNECT_ATTEMPTS = 300;
+
+// Default size limit of the result cache (--cache-size, in MiB)
+const long CACHE_DEFAULT_SIZE_MB = 1024;
+
+// Default number of random vectors and relative tolerance for --verify=freivalds
+const int FREIVALDS_DEFAULT_ROUNDS = 3;
+const double FREIVALDS_DEFAULT_TOLERANCE = 1e-9;
+
+// Inputs of the memory planner: the stored shapes of A and B and the chosen mode
+struct MemoryRequest {
+    long rows_A = 0, cols_A = 0;
+    long rows_B = 0, cols_B = 0;
+    int num_processes = 1;
+    KernelConfig config;
+    bool baseline = true;
+    bool verify = false;
+    bool pipeline = false;
+    bool delta = false;
+};
+
+// Planned peak memory and the changes made to stay under --mem-limit
+struct MemoryPlan {
+    double limit_bytes = 0.0;       // 0: no limit
+    double base_bytes = 0.0;        // resident size before the inputs are read
+    double parent_bytes = 0.0;      // planned peak of the parent, base included
+    double worker_bytes = 0.0;      // planned private memory of each worker
+    double total_bytes = 0.0;       // parent plus all workers
+    int workers = 0;
+    bool baseline_after = false;    // sequential baseline once the shared segments are released
+    bool drop_baseline = false;     // no sequential baseline, as with --no-baseline
+    bool inline_fast_path = false;  // degenerate shapes computed in the parent, without shared copies
+    vector<string> decisions;
+};
+
+// Heap cost of a row of a nested matrix besides its values: the vector object
+// in the outer array plus the malloc chunk header and alignment
+const long NESTED_ROW_OVERHEAD = 24 + 16;
+
+TraceBuffer* g_trace = nullptr;
+TraceRing* g_trace_ring = nullptr;
+
+// Shared memory names are prefixed with the pid of the parent so that
+// concurrent runs do not collide; workers started with exec receive the prefix
+string g_shm_prefix = "/matrix_";
+SpawnStrategy g_spawn_strategy = SPAWN_FORK;
+bool g_prefault = false;
+
+// Set by the memory planner: compute degenerate shapes inline whatever their size
+bool g_fast_path_inline = false;
+
+// Start timestamp written by each worker, indexed by worker, to measure spawn latency
+uint64_t* g_spawn_times = nullptr;
+int g_spawn_capacity = 0;
+vector<uint64_t> g_spawn_issued, g_spawn_returned;
+SpawnStats g_spawn_stats;
+FastPathStats g_fast_path_stats;
+
+// Process that owns the segments living for the whole run (trace, spawn
+// timestamps); only it releases them at exit
+pid_t g_cleanup_pid = 0;
+
+// Process that started the current workers (0 in workers started with exec)
+pid_t g_spawn_parent = 0;
+
+// Connections of a SUMMA rank to its peers. Workers close their copies, so
+// that the peers see the connections drop when the rank dies.
+vector<int> g_summa_sockets;
+
+// Stack slots of clone workers. Clone workers share the address space, so they
+// cannot keep per-worker globals; they find their CloneWorker from the stack
+// slot they are running on. Each slot holds a stack of CLONE_STACK_SIZE
+// followed by the scratch buffer of the worker.
+char* g_clone_stacks = nullptr;
+size_t g_clone_stacks_size = 0;
+size_t g_clone_slot_size = 0;
+
 // Function declarations remain unchanged
 vector<vector<double>> readMatrix(const string& filename, int& rows, int& cols);
 void writeMatrix(const string& filename, const vector<vector<double>>& matrix);
-vector<vector<double>> multiplyMatricesSequential(const vector<vector<double>>& A, const vector<vector<double>>& B);
+vector<vector<double>> multiplyMatricesSequential(const vector<vector<double>>& A, const vector<vector<double>>& B,
+                                                  bool trans_a = false, bool trans_b = false);
+string shmName(const string& suffix);
+void* createSharedSegment(const string& shm_name, size_t size);
+void* openSharedSegment(const string& shm_name, size_t& size);
 void* createSharedMatrix(const vector<vector<double>>& matrix, const string& shm_name);
+void* createEmptySharedMatrix(int rows, int cols, const string& shm_name);
 double getMatrixElement(void* shm_ptr, int row, int col);
 void setMatrixElement(void* shm_ptr, int row, int col, double value);
 vector<vector<double>> extractMatrix(void* shm_ptr);
-void calculateMatrixPortion(void* matrixA, void* matrixB, void* matrixC, int start_row, int end_row);
+void multiplyRowsNaive(const double* A, const double* B, double* C, int M, int P, int start_row, int end_row);
+void multiplyRowsIKJ(const double* A, const double* B, double* C, int M, int P, int start_row, int end_row);
+void multiplyRowsTiled(const double* A, const double* B, double* C, int M, int P, int start_row, int end_row,
+                       const KernelConfig& config);
+void multiplyRowsTransB(const double* A, const double* Bt, double* C, int M, int P, int start_row, int end_row,
+                        const KernelConfig& config);
+void packTransposedRows(const double* At, int N, int M, int start_row, int end_row, double* packed);
+void multiplyRows(const double* A, const double* B, double* C, int M, int P, int start_row, int end_row,
+                  const KernelConfig& config);
+void operandShapes(void* matrixA, void* matrixB, const KernelConfig& config, int& N, int& M, int& P);
+void calculateMatrixPortion(void* matrixA, void* matrixB, void* matrixC, int start_row, int end_row,
+                            const KernelConfig& config = KernelConfig());
+void calculateMatrixRows(const double* A, const double* B, double* C, int N, int M, int P,
+                         int start_row, int end_row, const KernelConfig& config);
+int rowBlockRows(int M, int P);
+FastPathShape fastPathShape(int N, int M, int P);
+template <typename Rows>
+void gemvRows(Rows A_rows, const double* x, double* y, int M, int start_row, int end_row);
+template <typename Rows>
+void vecmatColumns(const double* a, Rows B_rows, double* c, int M, int start_col, int end_col);
+template <typename Rows>
+void outerRows(const double* a, const double* b, Rows C_rows, int P, int start_row, int end_row);
+void calculateFastPathPortion(void* matrixA, void* matrixB, void* matrixC, SharedFastPathData* fast, int index,
+                              int start, int end,
+                              const KernelConfig& config);
+vector<double> flattenMatrix(const vector<vector<double>>& matrix);
+vector<vector<double>> multiplyMatricesFastPath(const vector<vector<double>>& A, const vector<vector<double>>& B,
+                                                int num_processes, FastPathShape shape, const KernelConfig& config);
 void cleanupSharedMemory(const string& shm_name, void* ptr, size_t size);
-vector<vector<double>> multiplyMatricesParallel(const vector<vector<double>>& A, const vector<vector<double>>& B, int num_processes);
+vector<vector<double>> multiplyMatricesParallel(const vector<vector<double>>& A, const vector<vector<double>>& B, int num_processes,
+                                                const KernelConfig& config = KernelConfig());
+bool parseKernelName(const string& name, KernelType& kernel);
+bool parseTileSizes(const string& spec, KernelConfig& config);
+string describeKernel(const KernelConfig& config);
+string hostName();
+string shapeClass(int N, int M, int P);
+string defaultTuningFile();
+vector<TuningEntry> loadTuningFile(const string& path);
+bool lookupTuning(const string& path, int N, int M, int P, TuningEntry& entry);
+void saveTuningEntry(const string& path, const TuningEntry& entry);
+long probeCacheSize(int level);
+uint64_t hashMatrix(const vector<vector<double>>& matrix);
+string defaultCacheDir();
+string cacheKey(uint64_t hashA, uint64_t hashB, bool trans_a, bool trans_b);
+int lockCacheDir(const string& dir, int operation);
+bool cacheLookup(const string& dir, const string& key, int N, int P, vector<vector<double>>& C);
+bool cacheStore(const string& dir, const string& key, const vector<vector<double>>& C, long max_bytes, int& evicted);
+bool parseSpawnStrategy(const string& name, SpawnStrategy& strategy);
+void runWorker(const WorkerTask& task, const WorkerSegments& segments, const KernelConfig& config);
+int cloneWorkerEntry(void* arg);
+size_t workerScratchCount(const WorkerTask& task, const WorkerSegments& segments, const KernelConfig& config);
+double* workerScratch(size_t count, vector<double>& fallback);
+pid_t vforkExec(char* const* argv);
+bool spawnWorkers(const vector<WorkerTask>& tasks, const WorkerSegments& segments, const KernelConfig& config,
+                  vector<pid_t>& child_pids);
+bool waitWorkers(const vector<pid_t>& child_pids);
+void cleanupSpawnResources();
+int workerMain(int argc, char* argv[]);
+void closeInheritedDescriptors(int keep);
+bool startDaemonWorker(const KernelConfig& config, DaemonWorker& worker);
+void daemonWorkerLoop(int sock, const KernelConfig& config);
+bool readJobHeader(int fd, bool input, MatmulMatrixHeader& header, size_t& size);
+int daemonMain(int argc, char* argv[]);
+void blockRange(int n, int parts, int index, int& begin, int& end);
+bool parseGridShape(const string& spec, SummaGrid& grid);
+bool parsePeers(const string& list, vector<string>& peers);
+bool sendAll(int sock, const void* data, size_t bytes);
+bool recvAll(int sock, void* data, size_t bytes);
+int listenSummaPort(const string& address);
+vector<int> connectSummaPeers(const SummaGrid& grid, int listen_fd);
+vector<double> readMatrixBlock(const string& filename, int row_begin, int row_end, int col_begin, int col_end);
+bool sendSummaStats(int sock, const SummaStats& stats);
+bool recvSummaStats(int sock, SummaStats& stats);
+vector<double> multiplyMatricesSumma(const string& fileA, const string& fileB, int N, int M, int P,
+                                     const SummaGrid& grid, const vector<int>& socks, int num_processes,
+                                     const KernelConfig& config, SummaStats& stats);
+int runSummaRank(const string& fileA, const string& fileB, const SummaGrid& grid, int listen_fd, int num_processes,
+                 const KernelConfig& config);
+int launchSummaLocal(const string& fileA, const string& fileB, SummaGrid grid, int num_processes,
+                     const KernelConfig& config);
+void cleanupSegmentsOf(pid_t pid);
+void futexWait(atomic<int>* addr, int expected, const timespec* timeout = nullptr);
+void futexWake(atomic<int>* addr);
+long rawFutex(atomic<int>* addr, int op, int value, const timespec* timeout);
+bool waitForCount(atomic<int>* counter, int target, const vector<pid_t>& child_pids);
+void calculateSummaPortion(void* panelsA, void* panelsB, void* matrixC, SharedSummaData* summa, int start_row,
+                           int end_row, const KernelConfig& config);
+void abortPipeline(SharedPipelineData* pipeline);
+void calculatePipelinedPortion(void* matrixA, void* matrixB, void* matrixC, SharedPipelineData* pipeline,
+                               const KernelConfig& config);
+vector<vector<double>> multiplyMatricesPipelined(const string& fileA, int N, int M, const vector<vector<double>>& B,
+                                                 int num_processes, const KernelConfig& config,
+                                                 bool keep_A, vector<vector<double>>& A, PipelineStats& stats);
+vector<int> findChangedRows(const vector<vector<double>>& previous, const vector<vector<double>>& current);
+void calculateDeltaPortion(void* matrixA, void* matrixB, void* matrixC, void* delta, int start_task, int end_task,
+                           const KernelConfig& config);
+vector<vector<double>> multiplyMatricesDelta(const vector<vector<double>>& A, const vector<vector<double>>& B,
+                                             const vector<vector<double>>& prev_A, const vector<vector<double>>& prev_B,
+                                             const vector<vector<double>>& prev_C, int num_processes,
+                                             const KernelConfig& config, DeltaStats& stats);
+void calculateTunedPortion(void* matrixA, void* matrixB, void* matrixC, SharedTuneData* tune, int index,
+                           int start_row, int end_row, const KernelConfig& config);
+double measureKernel(void* shm_A, void* shm_B, void* shm_C, void* shm_tune, int rows, int num_processes,
+                     const KernelConfig& config);
+TuningEntry tuneConfiguration(const vector<vector<double>>& A, const vector<vector<double>>& B);
+bool verifyFreivalds(const vector<vector<double>>& A, const vector<vector<double>>& B, const vector<vector<double>>& C,
+                     int rounds, double tolerance, double& max_residual, bool trans_a = false, bool trans_b = false);
+bool parseMemorySize(const string& spec, double& bytes);
+long procStatusKB(const string& field);
+double nestedMatrixBytes(long rows, long cols);
+double sharedMatrixBytes(long rows, long cols);
+void estimateMemory(const MemoryRequest& request, MemoryPlan& plan);
+MemoryPlan planMemory(const MemoryRequest& request, double base_bytes, double limit_bytes);
+string describeMemoryPlan(const MemoryPlan& plan);
+uint64_t traceNow();
+void createTraceBuffer(int n_rings);
+void resizeTraceBuffer(int n_rings);
+void traceAttach(int ring);
+CloneWorker* currentCloneWorker();
+TraceRing* currentTraceRing();
+void traceEvent(TracePhase phase, char type, int arg0 = 0, int arg1 = 0);
+void exportTrace(const string& filename);
+void cleanupTraceBuffer();
+void cleanupAtExit();
 void printUsage(const char* programName);
 
-// Function to read matrix from file
+// Function to read matrix from file (text or binary format)
 vector<vector<double>> readMatrix(const string& filename, int& rows, int& cols) {
-    ifstream file(filename);
-    if (!file.is_open()) {
-        cerr << "Error opening file: " << filename << endl;
+    MatrixStreamReader reader;
+    if (!reader.open(filename)) {
+        cerr << reader.error() << endl;
         exit(1);
     }
 
     vector<vector<double>> matrix;
-    string line;
+    vector<double> row;
     rows = 0;
     
-    // Read the file line by line
-    while (getline(file, line)) {
-        if (!line.empty()) {
-            istringstream iss(line);
-            vector<double> row;
-            double value;
-            
-            // Parse values from the current line
-            while (iss >> value) {
-                row.push_back(value);
-            }
-            
-            // Only add non-empty rows
-            if (!row.empty()) {
-                // Set the number of columns based on the first row
-                if (rows == 0) {
-                    cols = row.size();
-                } else if (row.size() != cols) {
-                    cerr << "Error: Inconsistent number of columns in row " << rows << endl;
-                    exit(1);
-                }
-                
-                matrix.push_back(row);
-                rows++;
-            }
-        }
+    // Read the file one row at a time
+    long got;
+    while ((got = reader.readRows(row, 1)) > 0) {
+        matrix.push_back(row);
+        row.clear();
+        rows++;
+    }
+    
+    if (got < 0) {
+        cerr << reader.error() << endl;
+        exit(1);
     }
     
     if (rows == 0) {
@@ -96,7 +677,7 @@ vector<vector<double>> readMatrix(const string& filename, int& rows, int& cols)
         exit(1);
     }
     
-    file.close();
+    cols = reader.cols();
     return matrix;
 }
 
@@ -127,10 +708,12 @@ void writeMatrix(const string& filename, const vector<vector<double>>& matrix) {
 
 
 // Function to multiply matrices sequentially
-vector<vector<double>> multiplyMatricesSequential(const vector<vector<double>>& A, const vector<vector<double>>& B) {
-    int N = A.size();       // Number of rows in A
-    int M = A[0].size();    // Number of columns in A (= Number of rows in B)
-    int P = B[0].size();    // Number of columns in B
+// A transposed operand is read in place: element (i, k) of A^T is A[k][i].
+vector<vector<double>> multiplyMatricesSequential(const vector<vector<double>>& A, const vector<vector<double>>& B,
+                                                  bool trans_a, bool trans_b) {
+    int N = trans_a ? A[0].size() : A.size();   // Number of rows in op(A)
+    int M = trans_a ? A.size() : A[0].size();   // Number of columns in op(A) (= Number of rows in op(B))
+    int P = trans_b ? B.size() : B[0].size();   // Number of columns in op(B)
     
     // Initialize result matrix C with zeros
     vector<vector<double>> C(N, vector<double>(P, 0.0));
@@ -140,7 +723,7 @@ vector<vector<double>> multiplyMatricesSequential(const vector<vector<double>>&
         for (int j = 0; j < P; j++) {
             // Calculate C[i][j]
             for (int k = 0; k < M; k++) {
-                C[i][j] += A[i][k] * B[k][j];
+                C[i][j] += (trans_a ? A[k][i] : A[i][k]) * (trans_b ? B[j][k] : B[k][j]);
             }
         }
     }
@@ -148,53 +731,97 @@ vector<vector<double>> multiplyMatricesSequential(const vector<vector<double>>&
     return C;
 }
 
-// Function to create shared memory for a matrix
-void* createSharedMatrix(const vector<vector<double>>& matrix, const string& shm_name) {
-    int rows = matrix.size();
-    int cols = matrix[0].size();
-    
-    // Calculate total size needed for SharedMatrixData + matrix data
-    size_t matrix_data_size = rows * cols * sizeof(double);
-    size_t total_size = sizeof(SharedMatrixData) + matrix_data_size;
-    
-    // Create shared memory
+// Function to get the name of one of this run's shared memory segments
+string shmName(const string& suffix) {
+    return g_shm_prefix + suffix;
+}
+
+// Function to create and map a shared memory segment. With --prefault the
+// pages are populated up front (MAP_POPULATE), so workers do not take page
+// faults on first touch.
+void* createSharedSegment(const string& shm_name, size_t size) {
     int shm_fd = shm_open(shm_name.c_str(), O_CREAT | O_RDWR, 0666);
     if (shm_fd == -1) {
-        cerr << "Error creating shared memory: " << strerror(errno) << endl;
+        cerr << "Error creating shared memory " << shm_name << ": " << strerror(errno) << endl;
         exit(1);
     }
     
     // Set the size of the shared memory segment
-    if (ftruncate(shm_fd, total_size) == -1) {
-        cerr << "Error setting size of shared memory: " << strerror(errno) << endl;
+    if (ftruncate(shm_fd, size) == -1) {
+        cerr << "Error setting size of shared memory " << shm_name << ": " << strerror(errno) << endl;
         exit(1);
     }
     
     // Map the shared memory segment into the address space
-    void* ptr = mmap(0, total_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    int flags = MAP_SHARED | (g_prefault ? MAP_POPULATE : 0);
+    void* ptr = mmap(0, size, PROT_READ | PROT_WRITE, flags, shm_fd, 0);
+    if (ptr == MAP_FAILED) {
+        cerr << "Error mapping shared memory " << shm_name << ": " << strerror(errno) << endl;
+        exit(1);
+    }
+    close(shm_fd);
+    return ptr;
+}
+
+// Function to map an existing shared memory segment (used by exec'd workers)
+void* openSharedSegment(const string& shm_name, size_t& size) {
+    int shm_fd = shm_open(shm_name.c_str(), O_RDWR, 0666);
+    if (shm_fd == -1) {
+        cerr << "Error opening shared memory " << shm_name << ": " << strerror(errno) << endl;
+        exit(1);
+    }
+    
+    struct stat st;
+    if (fstat(shm_fd, &st) == -1) {
+        cerr << "Error reading size of shared memory " << shm_name << ": " << strerror(errno) << endl;
+        exit(1);
+    }
+    size = st.st_size;
+    
+    int flags = MAP_SHARED | (g_prefault ? MAP_POPULATE : 0);
+    void* ptr = mmap(0, size, PROT_READ | PROT_WRITE, flags, shm_fd, 0);
     if (ptr == MAP_FAILED) {
-        cerr << "Error mapping shared memory: " << strerror(errno) << endl;
+        cerr << "Error mapping shared memory " << shm_name << ": " << strerror(errno) << endl;
         exit(1);
     }
+    close(shm_fd);
+    return ptr;
+}
+
+// Function to create shared memory for a matrix
+void* createSharedMatrix(const vector<vector<double>>& matrix, const string& shm_name) {
+    int rows = matrix.size();
+    int cols = matrix[0].size();
     
-    // Fill in the metadata
-    SharedMatrixData* metadata = static_cast<SharedMatrixData*>(ptr);
-    metadata->n_rows = rows;
-    metadata->n_cols = cols;
+    void* ptr = createEmptySharedMatrix(rows, cols, shm_name);
     
     // Get pointer to the matrix data area
     double* matrix_data = reinterpret_cast<double*>(static_cast<char*>(ptr) + sizeof(SharedMatrixData));
     
     // Copy matrix data to shared memory
     for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
-            matrix_data[i * cols + j] = matrix[i][j];
-        }
+        copy(matrix[i].begin(), matrix[i].end(), matrix_data + (long)i * cols);
     }
     
     return ptr;
 }
 
+// Function to create shared memory for a zero-filled matrix
+void* createEmptySharedMatrix(int rows, int cols, const string& shm_name) {
+    // Calculate total size needed for SharedMatrixData + matrix data
+    size_t matrix_data_size = (size_t)rows * cols * sizeof(double);
+    size_t total_size = sizeof(SharedMatrixData) + matrix_data_size;
+    
+    void* ptr = createSharedSegment(shm_name, total_size);
+    
+    // Fill in the metadata
+    SharedMatrixData* metadata = static_cast<SharedMatrixData*>(ptr);
+    metadata->n_rows = rows;
+    metadata->n_cols = cols;
+    
+    return ptr;
+}
+
 // Function to access matrix data in shared memory
 double getMatrixElement(void* shm_ptr, int row, int col) {
     SharedMatrixData* metadata = static_cast<SharedMatrixData*>(shm_ptr);
@@ -229,143 +856,3416 @@ vector<vector<double>> extractMatrix(void* shm_ptr) {
     return matrix;
 }
 
-// Child process function to calculate portion of the result matrix
-void calculateMatrixPortion(void* matrixA, void* matrixB, void* matrixC, 
-                           int start_row, int end_row) {
-    SharedMatrixData* metadataA = static_cast<SharedMatrixData*>(matrixA);
-    SharedMatrixData* metadataB = static_cast<SharedMatrixData*>(matrixB);
-    SharedMatrixData* metadataC = static_cast<SharedMatrixData*>(matrixC);
-    
-    int M = metadataA->n_cols;  // Columns in A = Rows in B
-    int P = metadataB->n_cols;  // Columns in B
-    
-    // Calculate assigned portion of the result matrix
+// Kernel computing C rows [start_row, end_row) as one dot product per element
+void multiplyRowsNaive(const double* A, const double* B, double* C, int M, int P, int start_row, int end_row) {
     for (int i = start_row; i < end_row; i++) {
         for (int j = 0; j < P; j++) {
             double sum = 0.0;
             for (int k = 0; k < M; k++) {
-                sum += getMatrixElement(matrixA, i, k) * getMatrixElement(matrixB, k, j);
+                sum += A[(long)i * M + k] * B[(long)k * P + j];
             }
-            setMatrixElement(matrixC, i, j, sum);
+            C[(long)i * P + j] = sum;
         }
     }
 }
 
-// Function to clean up shared memory
-void cleanupSharedMemory(const string& shm_name, void* ptr, size_t size) {
-    munmap(ptr, size);
-    shm_unlink(shm_name.c_str());
+// Kernel computing C rows [start_row, end_row) by accumulating scaled rows of B.
+// Every element still sums over k in increasing order, so the result is
+// identical to the naive kernel.
+void multiplyRowsIKJ(const double* A, const double* B, double* C, int M, int P, int start_row, int end_row) {
+    for (int i = start_row; i < end_row; i++) {
+        double* c_row = C + (long)i * P;
+        fill(c_row, c_row + P, 0.0);
+        for (int k = 0; k < M; k++) {
+            double a = A[(long)i * M + k];
+            const double* b_row = B + (long)k * P;
+            for (int j = 0; j < P; j++) {
+                c_row[j] += a * b_row[j];
+            }
+        }
+    }
 }
 
-// Function to multiply matrices in parallel
-vector<vector<double>> multiplyMatricesParallel(const vector<vector<double>>& A, 
-                                               const vector<vector<double>>& B, 
-                                               int num_processes) {
-    int N = A.size();
-    int M = A[0].size();
-    int P = B[0].size();
-    
-    // Adjust number of processes if needed
-    if (num_processes > N) {
-        cout << "Warning: Number of processes reduced to number of rows in the result matrix (" << N << ")" << endl;
-        num_processes = N;
+// Kernel computing C rows [start_row, end_row) with the ikj order over tiles, so
+// that a tile_depth x tile_cols block of B stays in cache while it is reused by
+// all rows. Tiles of k are visited in increasing order, which keeps the result
+// identical to the naive kernel.
+void multiplyRowsTiled(const double* A, const double* B, double* C, int M, int P, int start_row, int end_row,
+                       const KernelConfig& config) {
+    for (int i = start_row; i < end_row; i++) {
+        fill(C + (long)i * P, C + (long)(i + 1) * P, 0.0);
     }
     
-    // Create shared memory for matrices
-    void* shm_A = createSharedMatrix(A, "/matrix_A");
-    void* shm_B = createSharedMatrix(B, "/matrix_B");
-    
-    // Create shared memory for result matrix C
-    size_t C_data_size = N * P * sizeof(double);
-    size_t C_total_size = sizeof(SharedMatrixData) + C_data_size;
-    
-    int shm_C_fd = shm_open("/matrix_C", O_CREAT | O_RDWR, 0666);
-    if (shm_C_fd == -1) {
-        cerr << "Error creating shared memory for C: " << strerror(errno) << endl;
-        exit(1);
+    for (int jj = 0; jj < P; jj += config.tile_cols) {
+        int j_end = min(jj + config.tile_cols, P);
+        for (int kk = 0; kk < M; kk += config.tile_depth) {
+            int k_end = min(kk + config.tile_depth, M);
+            for (int ii = start_row; ii < end_row; ii += config.tile_rows) {
+                int i_end = min(ii + config.tile_rows, end_row);
+                for (int i = ii; i < i_end; i++) {
+                    double* c_row = C + (long)i * P;
+                    for (int k = kk; k < k_end; k++) {
+                        double a = A[(long)i * M + k];
+                        const double* b_row = B + (long)k * P;
+                        for (int j = jj; j < j_end; j++) {
+                            c_row[j] += a * b_row[j];
+                        }
+                    }
+                }
+            }
+        }
     }
-    
-    if (ftruncate(shm_C_fd, C_total_size) == -1) {
-        cerr << "Error setting size of shared memory for C: " << strerror(errno) << endl;
-        exit(1);
+}
+
+// Kernel computing C rows [start_row, end_row) of A * B^T, with B^T stored as
+// P x M: every element is the dot product of two contiguous rows, so both
+// operands are read with unit stride. Except for the naive kernel, columns are
+// visited in tiles of tile_cols rows of B^T, which stay in cache while they
+// are reused by all the rows.
+void multiplyRowsTransB(const double* A, const double* Bt, double* C, int M, int P, int start_row, int end_row,
+                        const KernelConfig& config) {
+    int tile_cols = config.kernel == KERNEL_NAIVE ? P : config.tile_cols;
+    for (int jj = 0; jj < P; jj += tile_cols) {
+        int j_end = min(jj + tile_cols, P);
+        for (int i = start_row; i < end_row; i++) {
+            const double* a_row = A + (long)i * M;
+            for (int j = jj; j < j_end; j++) {
+                const double* b_row = Bt + (long)j * M;
+                double sum = 0.0;
+                for (int k = 0; k < M; k++) {
+                    sum += a_row[k] * b_row[k];
+                }
+                C[(long)i * P + j] = sum;
+            }
+        }
     }
-    
-    void* shm_C = mmap(0, C_total_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_C_fd, 0);
-    if (shm_C == MAP_FAILED) {
-        cerr << "Error mapping shared memory for C: " << strerror(errno) << endl;
-        exit(1);
+}
+
+// Function to pack rows [start_row, end_row) of A^T, with A^T stored as M x N,
+// into a contiguous (end_row - start_row) x M block. Each stored row is read
+// once with unit stride.
+void packTransposedRows(const double* At, int N, int M, int start_row, int end_row, double* packed) {
+    int rows = end_row - start_row;
+    for (int k = 0; k < M; k++) {
+        const double* src = At + (long)k * N + start_row;
+        for (int i = 0; i < rows; i++) {
+            packed[(long)i * M + k] = src[i];
+        }
+    }
+}
+
+// Function to run the selected kernel over C rows [start_row, end_row)
+void multiplyRows(const double* A, const double* B, double* C, int M, int P, int start_row, int end_row,
+                  const KernelConfig& config) {
+    if (config.trans_b) {
+        multiplyRowsTransB(A, B, C, M, P, start_row, end_row, config);
+        return;
     }
+    switch (config.kernel) {
+        case KERNEL_NAIVE:
+            multiplyRowsNaive(A, B, C, M, P, start_row, end_row);
+            break;
+        case KERNEL_IKJ:
+            multiplyRowsIKJ(A, B, C, M, P, start_row, end_row);
+            break;
+        case KERNEL_TILED:
+            multiplyRowsTiled(A, B, C, M, P, start_row, end_row, config);
+            break;
+    }
+}
+
+// Function to get the shape of op(A) (N x M) and op(B) (M x P) from the stored shared matrices
+void operandShapes(void* matrixA, void* matrixB, const KernelConfig& config, int& N, int& M, int& P) {
+    SharedMatrixData* metadataA = static_cast<SharedMatrixData*>(matrixA);
+    SharedMatrixData* metadataB = static_cast<SharedMatrixData*>(matrixB);
     
-    // Initialize C metadata
-    SharedMatrixData* C_metadata = static_cast<SharedMatrixData*>(shm_C);
-    C_metadata->n_rows = N;
-    C_metadata->n_cols = P;
+    N = config.trans_a ? metadataA->n_cols : metadataA->n_rows;
+    M = config.trans_a ? metadataA->n_rows : metadataA->n_cols;
+    P = config.trans_b ? metadataB->n_rows : metadataB->n_cols;
+}
+
+// Child process function to calculate portion of the result matrix
+void calculateMatrixPortion(void* matrixA, void* matrixB, void* matrixC, 
+                           int start_row, int end_row, const KernelConfig& config) {
+    int N, M, P;  // Columns in op(A) = Rows in op(B)
+    operandShapes(matrixA, matrixB, config, N, M, P);
     
-    // Calculate rows per process
-    int rows_per_process = N / num_processes;
-    int remaining_rows = N % num_processes;
+    const double* A = reinterpret_cast<const double*>(static_cast<char*>(matrixA) + sizeof(SharedMatrixData));
+    const double* B = reinterpret_cast<const double*>(static_cast<char*>(matrixB) + sizeof(SharedMatrixData));
+    double* C = reinterpret_cast<double*>(static_cast<char*>(matrixC) + sizeof(SharedMatrixData));
     
-    // Fork processes to perform multiplication
-    pid_t pid;
-    vector<pid_t> child_pids;
+    calculateMatrixRows(A, B, C, N, M, P, start_row, end_row, config);
+}
+
+// Function to calculate rows [start_row, end_row) of C = op(A) * op(B) for
+// shapes given by the caller rather than read from the segment headers
+void calculateMatrixRows(const double* A, const double* B, double* C, int N, int M, int P,
+                         int start_row, int end_row, const KernelConfig& config) {
+    // Rows are processed in blocks so that each block can be traced
+    int block_rows = rowBlockRows(M, P);
     
-    for (int i = 0; i < num_processes; i++) {
-        pid = fork();
-        
-        if (pid < 0) {
-            cerr << "Error: Fork failed" << endl;
-            // Clean up before exiting
-            cleanupSharedMemory("/matrix_A", shm_A, sizeof(SharedMatrixData) + N * M * sizeof(double));
-            cleanupSharedMemory("/matrix_B", shm_B, sizeof(SharedMatrixData) + M * P * sizeof(double));
-            cleanupSharedMemory("/matrix_C", shm_C, C_total_size);
-            exit(1);
-        }
-        else if (pid == 0) {
-            // Child process
-            int start_row = i * rows_per_process + min(i, remaining_rows);
-            int end_row = (i + 1) * rows_per_process + min(i + 1, remaining_rows);
-            
-            calculateMatrixPortion(shm_A, shm_B, shm_C, start_row, end_row);
-            
-            // Child process exits after calculation
-            exit(0);
-        }
-        else {
-            // Parent process
-            child_pids.push_back(pid);
-        }
+    // Rows of A^T are columns of the stored matrix; they are packed block by block
+    vector<double> packed_buffer;
+    double* packed = nullptr;
+    if (config.trans_a && end_row > start_row) {
+        packed = workerScratch((size_t)min(block_rows, end_row - start_row) * M, packed_buffer);
     }
     
-    // Parent waits for all child processes to complete
-    for (pid_t child_pid : child_pids) {
-        int status;
-        waitpid(child_pid, &status, 0);
+    // Calculate assigned portion of the result matrix
+    for (int block_start = start_row; block_start < end_row; block_start += block_rows) {
+        int block_end = min(block_start + block_rows, end_row);
+        traceEvent(PHASE_ROW_BLOCK, 'B', block_start, block_end);
+        if (config.trans_a) {
+            packTransposedRows(A, N, M, block_start, block_end, packed);
+            multiplyRows(packed, B, C + (long)block_start * P, M, P, 0, block_end - block_start, config);
+        } else {
+            multiplyRows(A, B, C, M, P, block_start, block_end, config);
+        }
+        traceEvent(PHASE_ROW_BLOCK, 'E', block_start, block_end);
     }
-    
-    // Extract result matrix from shared memory
-    vector<vector<double>> C = extractMatrix(shm_C);
-    
-    // Clean up shared memory
-    cleanupSharedMemory("/matrix_A", shm_A, sizeof(SharedMatrixData) + N * M * sizeof(double));
-    cleanupSharedMemory("/matrix_B", shm_B, sizeof(SharedMatrixData) + M * P * sizeof(double));
-    cleanupSharedMemory("/matrix_C", shm_C, C_total_size);
-    
-    return C;
 }
 
-void printUsage(const char* programName) {
-    cout << "Usage: " << programName << " <matrix_A_file> <matrix_B_file> [options]" << endl;
-    cout << "Options:" << endl;
-    cout << "  -n <num_processes>   Number of processes to use (default: 1, sequential)" << endl;
-    cout << "  -o <output_file>     Output file name (default: output.txt)" << endl;
-    cout << endl;
-    cout << "Examples:" << endl;
+// Function to get the number of rows calculateMatrixRows processes (and traces)
+// as one block when op(B) is M x P
+int rowBlockRows(int M, int P) {
+    long row_work = max(1L, (long)M * P);
+    return (int)max(1L, TRACE_MIN_BLOCK_WORK / row_work);
+}
+
+// Function to pick the fast path for a shape. With one row or one column
+// every element of A, B and C is used only once or twice, so these products
+// are limited by memory bandwidth and the blocked kernels cannot help.
+FastPathShape fastPathShape(int N, int M, int P) {
+    if (P == 1) return SHAPE_GEMV;
+    if (N == 1) return SHAPE_VECMAT;
+    if (M == 1) return SHAPE_OUTER;
+    return SHAPE_GENERAL;
+}
+
+// Kernel computing y[i] = A[i] . x for rows [start_row, end_row). Four rows are
+// processed together so that each x[k] is loaded once for four independent
+// sums; each sum still runs over k in increasing order, as in the naive kernel.
+template <typename Rows>
+void gemvRows(Rows A_rows, const double* x, double* y, int M, int start_row, int end_row) {
+    int i = start_row;
+    for (; i + 4 <= end_row; i += 4) {
+        const double* a0 = A_rows[i];
+        const double* a1 = A_rows[i + 1];
+        const double* a2 = A_rows[i + 2];
+        const double* a3 = A_rows[i + 3];
+        double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+        for (int k = 0; k < M; k++) {
+            double xk = x[k];
+            s0 += a0[k] * xk;
+            s1 += a1[k] * xk;
+            s2 += a2[k] * xk;
+            s3 += a3[k] * xk;
+        }
+        y[i] = s0;
+        y[i + 1] = s1;
+        y[i + 2] = s2;
+        y[i + 3] = s3;
+    }
+    for (; i < end_row; i++) {
+        const double* a = A_rows[i];
+        double sum = 0.0;
+        for (int k = 0; k < M; k++) {
+            sum += a[k] * x[k];
+        }
+        y[i] = sum;
+    }
+}
+
+// Kernel computing c[j] = sum_k a[k] * B[k][j] for columns [start_col, end_col)
+// by accumulating scaled rows of B, so B is read with unit stride and the
+// inner loop vectorizes
+template <typename Rows>
+void vecmatColumns(const double* a, Rows B_rows, double* c, int M, int start_col, int end_col) {
+    fill(c + start_col, c + end_col, 0.0);
+    for (int k = 0; k < M; k++) {
+        double ak = a[k];
+        const double* b_row = B_rows[k];
+        for (int j = start_col; j < end_col; j++) {
+            c[j] += ak * b_row[j];
+        }
+    }
+}
+
+// Kernel computing the rank-1 product C[i][j] = a[i] * b[j] for rows [start_row, end_row)
+template <typename Rows>
+void outerRows(const double* a, const double* b, Rows C_rows, int P, int start_row, int end_row) {
+    for (int i = start_row; i < end_row; i++) {
+        double ai = a[i];
+        double* c_row = C_rows[i];
+        for (int j = 0; j < P; j++) {
+            c_row[j] = ai * b[j];
+        }
+    }
+}
+
+// Child process function for degenerate shapes: [start, end) are rows of C,
+// or columns for vecmat. The vector operand has the same layout whether or
+// not it is transposed; a transposed matrix operand turns gemv into vecmat
+// over the stored matrix and vice versa. The matrix operands are walked in
+// place with strides. The worker waits for the parent's release before the
+// kernel and records when it is done.
+void calculateFastPathPortion(void* matrixA, void* matrixB, void* matrixC, SharedFastPathData* fast, int index,
+                              int start, int end, const KernelConfig& config) {
+    int N, M, P;
+    operandShapes(matrixA, matrixB, config, N, M, P);
+    
+    const double* A = reinterpret_cast<const double*>(static_cast<char*>(matrixA) + sizeof(SharedMatrixData));
+    const double* B = reinterpret_cast<const double*>(static_cast<char*>(matrixB) + sizeof(SharedMatrixData));
+    double* C = reinterpret_cast<double*>(static_cast<char*>(matrixC) + sizeof(SharedMatrixData));
+    
+    fast->waiting.fetch_add(1, memory_order_acq_rel);
+    futexWake(&fast->waiting);
+    int released = fast->released.load(memory_order_acquire);
+    while (released == 0) {
+        futexWait(&fast->released, released);
+        released = fast->released.load(memory_order_acquire);
+    }
+    if (released == FAST_PATH_ABORTED) return;
+    
+    traceEvent(PHASE_ROW_BLOCK, 'B', start, end);
+    switch (fastPathShape(N, M, P)) {
+        case SHAPE_GEMV: {
+            StridedRows<const double> A_rows = {A, config.trans_a ? N : M};
+            if (config.trans_a) {
+                vecmatColumns(B, A_rows, C, M, start, end);
+            } else {
+                gemvRows(A_rows, B, C, M, start, end);
+            }
+            break;
+        }
+        case SHAPE_VECMAT: {
+            StridedRows<const double> B_rows = {B, config.trans_b ? M : P};
+            if (config.trans_b) {
+                gemvRows(B_rows, A, C, M, start, end);
+            } else {
+                vecmatColumns(A, B_rows, C, M, start, end);
+            }
+            break;
+        }
+        case SHAPE_OUTER:
+            outerRows(A, B, StridedRows<double>{C, P}, P, start, end);
+            break;
+        case SHAPE_GENERAL:
+            break;
+    }
+    traceEvent(PHASE_ROW_BLOCK, 'E', start, end);
+    
+    reinterpret_cast<uint64_t*>(fast + 1)[index] = traceNow();
+}
+
+// Function to copy a matrix into one row-major array
+vector<double> flattenMatrix(const vector<vector<double>>& matrix) {
+    vector<double> flat;
+    flat.reserve(matrix.size() * matrix[0].size());
+    for (const vector<double>& row : matrix) {
+        flat.insert(flat.end(), row.begin(), row.end());
+    }
+    return flat;
+}
+
+// Function to multiply a degenerate shape. Small products run inline in the
+// parent; larger ones are split among workers like the general case, by rows
+// of C or, for vecmat, by columns. Only the kernels are timed, without the
+// copies, the shared memory setup or the creation of the workers.
+vector<vector<double>> multiplyMatricesFastPath(const vector<vector<double>>& A, const vector<vector<double>>& B,
+                                                int num_processes, FastPathShape shape, const KernelConfig& config) {
+    int N = config.trans_a ? A[0].size() : A.size();
+    int M = config.trans_a ? A.size() : A[0].size();
+    int P = config.trans_b ? B.size() : B[0].size();
+    
+    FastPathStats stats;
+    stats.shape = shape;
+    stats.bytes = ((double)N * M + (double)M * P + (double)N * P) * sizeof(double);
+    stats.inline_run = stats.bytes < FAST_PATH_INLINE_BYTES || num_processes == 1 || g_fast_path_inline;
+    
+    // Allocated here only when computed inline; otherwise it is extracted from shared memory
+    vector<vector<double>> C;
+    
+    if (stats.inline_run) {
+        C.assign(N, vector<double>(P, 0.0));
+        
+        // The vector operand is flattened; the matrix operand is used in place, row by row
+        auto rowPointers = [](const vector<vector<double>>& matrix) {
+            vector<const double*> rows;
+            for (const vector<double>& row : matrix) {
+                rows.push_back(row.data());
+            }
+            return rows;
+        };
+        
+        chrono::high_resolution_clock::time_point start_kernel, end_kernel;
+        if (shape == SHAPE_GEMV) {
+            vector<double> x = flattenMatrix(B), y(N);
+            vector<const double*> A_rows = rowPointers(A);
+            start_kernel = chrono::high_resolution_clock::now();
+            if (config.trans_a) {
+                vecmatColumns(x.data(), A_rows.data(), y.data(), M, 0, N);
+            } else {
+                gemvRows(A_rows.data(), x.data(), y.data(), M, 0, N);
+            }
+            end_kernel = chrono::high_resolution_clock::now();
+            for (int i = 0; i < N; i++) {
+                C[i][0] = y[i];
+            }
+        } else if (shape == SHAPE_VECMAT) {
+            vector<double> a = flattenMatrix(A);
+            vector<const double*> B_rows = rowPointers(B);
+            start_kernel = chrono::high_resolution_clock::now();
+            if (config.trans_b) {
+                gemvRows(B_rows.data(), a.data(), C[0].data(), M, 0, P);
+            } else {
+                vecmatColumns(a.data(), B_rows.data(), C[0].data(), M, 0, P);
+            }
+            end_kernel = chrono::high_resolution_clock::now();
+        } else {
+            vector<double> a = flattenMatrix(A), b = flattenMatrix(B);
+            vector<double*> C_rows(N);
+            for (int i = 0; i < N; i++) {
+                C_rows[i] = C[i].data();
+            }
+            start_kernel = chrono::high_resolution_clock::now();
+            outerRows(a.data(), b.data(), C_rows.data(), P, 0, N);
+            end_kernel = chrono::high_resolution_clock::now();
+        }
+        stats.seconds = chrono::duration<double>(end_kernel - start_kernel).count();
+    } else {
+        traceEvent(PHASE_SHM_SETUP, 'B');
+        void* shm_A = createSharedMatrix(A, shmName("A"));
+        void* shm_B = createSharedMatrix(B, shmName("B"));
+        void* shm_C = createEmptySharedMatrix(N, P, shmName("C"));
+        size_t A_size = sizeof(SharedMatrixData) + (size_t)N * M * sizeof(double);
+        size_t B_size = sizeof(SharedMatrixData) + (size_t)M * P * sizeof(double);
+        size_t C_size = sizeof(SharedMatrixData) + (size_t)N * P * sizeof(double);
+        
+        int range = shape == SHAPE_VECMAT ? P : N;
+        int workers = min(num_processes, range);
+        size_t fast_size = sizeof(SharedFastPathData) + workers * sizeof(uint64_t);
+        void* shm_fast = createSharedSegment(shmName("fastpath"), fast_size);
+        SharedFastPathData* fast = new (shm_fast) SharedFastPathData();
+        fast->waiting.store(0, memory_order_relaxed);
+        fast->released.store(0, memory_order_relaxed);
+        fast->n_workers = workers;
+        traceEvent(PHASE_SHM_SETUP, 'E');
+        
+        auto cleanup = [&]() {
+            cleanupSharedMemory(shmName("A"), shm_A, A_size);
+            cleanupSharedMemory(shmName("B"), shm_B, B_size);
+            cleanupSharedMemory(shmName("C"), shm_C, C_size);
+            cleanupSharedMemory(shmName("fastpath"), shm_fast, fast_size);
+        };
+        
+        vector<WorkerTask> tasks;
+        for (int i = 0; i < workers; i++) {
+            int start, end;
+            blockRange(range, workers, i, start, end);
+            tasks.push_back({WORKER_FAST_PATH, i, start, end});
+        }
+        
+        // The clock starts once every worker is waiting for the release
+        vector<pid_t> child_pids;
+        bool spawned = spawnWorkers(tasks, {shm_A, shm_B, shm_C, shm_fast}, config, child_pids);
+        bool started = spawned && waitForCount(&fast->waiting, workers, child_pids);
+        uint64_t start_ns = traceNow();
+        fast->released.store(started ? 1 : FAST_PATH_ABORTED, memory_order_release);
+        futexWake(&fast->released);
+        bool succeeded = waitWorkers(child_pids) && started;
+        if (!spawned || !succeeded) {
+            cerr << "Error: " << (spawned ? "A worker process failed" : "Could not create worker processes") << endl;
+            cleanup();
+            exit(1);
+        }
+        const uint64_t* end_ns = reinterpret_cast<const uint64_t*>(fast + 1);
+        stats.seconds = (double)(*max_element(end_ns, end_ns + workers) - start_ns) / 1e9;
+        
+        traceEvent(PHASE_EXTRACT, 'B');
+        C = extractMatrix(shm_C);
+        traceEvent(PHASE_EXTRACT, 'E');
+        
+        cleanup();
+        stats.workers = workers;
+    }
+    
+    stats.calls = 1;
+    stats.workers = max(stats.workers, g_fast_path_stats.workers);
+    stats.inline_run = stats.inline_run && (g_fast_path_stats.calls == 0 || g_fast_path_stats.inline_run);
+    stats.calls += g_fast_path_stats.calls;
+    stats.bytes += g_fast_path_stats.bytes;
+    stats.seconds += g_fast_path_stats.seconds;
+    g_fast_path_stats = stats;
+    return C;
+}
+
+// Function to clean up shared memory
+void cleanupSharedMemory(const string& shm_name, void* ptr, size_t size) {
+    munmap(ptr, size);
+    shm_unlink(shm_name.c_str());
+}
+
+// Function to multiply matrices in parallel
+vector<vector<double>> multiplyMatricesParallel(const vector<vector<double>>& A, 
+                                               const vector<vector<double>>& B, 
+                                               int num_processes,
+                                               const KernelConfig& config) {
+    int N = config.trans_a ? A[0].size() : A.size();
+    int M = config.trans_a ? A.size() : A[0].size();
+    int P = config.trans_b ? B.size() : B[0].size();
+    
+    // Matrix-vector, vector-matrix and rank-1 products have their own kernels
+    FastPathShape shape = fastPathShape(N, M, P);
+    if (shape != SHAPE_GENERAL) {
+        return multiplyMatricesFastPath(A, B, num_processes, shape, config);
+    }
+    
+    // Adjust number of processes if needed
+    if (num_processes > N) {
+        cout << "Warning: Number of processes reduced to number of rows in the result matrix (" << N << ")" << endl;
+        num_processes = N;
+    }
+    
+    traceEvent(PHASE_SHM_SETUP, 'B');
+    
+    // Create shared memory for matrices
+    void* shm_A = createSharedMatrix(A, shmName("A"));
+    void* shm_B = createSharedMatrix(B, shmName("B"));
+    
+    // Create shared memory for result matrix C
+    void* shm_C = createEmptySharedMatrix(N, P, shmName("C"));
+    
+    size_t A_size = sizeof(SharedMatrixData) + (size_t)N * M * sizeof(double);
+    size_t B_size = sizeof(SharedMatrixData) + (size_t)M * P * sizeof(double);
+    size_t C_size = sizeof(SharedMatrixData) + (size_t)N * P * sizeof(double);
+    
+    traceEvent(PHASE_SHM_SETUP, 'E');
+    
+    // Calculate rows per process
+    int rows_per_process = N / num_processes;
+    int remaining_rows = N % num_processes;
+    
+    vector<WorkerTask> tasks;
+    for (int i = 0; i < num_processes; i++) {
+        int start_row = i * rows_per_process + min(i, remaining_rows);
+        int end_row = (i + 1) * rows_per_process + min(i + 1, remaining_rows);
+        tasks.push_back({WORKER_ROWS, i, start_row, end_row});
+    }
+    
+    // Spawn processes to perform multiplication and wait for them
+    vector<pid_t> child_pids;
+    bool spawned = spawnWorkers(tasks, {shm_A, shm_B, shm_C, nullptr}, config, child_pids);
+    bool succeeded = waitWorkers(child_pids);
+    
+    if (!spawned || !succeeded) {
+        cerr << "Error: " << (spawned ? "A worker process failed" : "Could not create worker processes") << endl;
+        // Clean up before exiting
+        cleanupSharedMemory(shmName("A"), shm_A, A_size);
+        cleanupSharedMemory(shmName("B"), shm_B, B_size);
+        cleanupSharedMemory(shmName("C"), shm_C, C_size);
+        exit(1);
+    }
+    
+    // Extract result matrix from shared memory
+    traceEvent(PHASE_EXTRACT, 'B');
+    vector<vector<double>> C = extractMatrix(shm_C);
+    traceEvent(PHASE_EXTRACT, 'E');
+    
+    // Clean up shared memory
+    cleanupSharedMemory(shmName("A"), shm_A, A_size);
+    cleanupSharedMemory(shmName("B"), shm_B, B_size);
+    cleanupSharedMemory(shmName("C"), shm_C, C_size);
+    
+    return C;
+}
+
+// Function to verify C = A * B with Freivalds' algorithm in O(rounds * n^2).
+// For each random vector r, A * (B * r) is compared against C * r. Each residual
+// is measured relative to |A| * (|B| * |r|), which bounds the rounding error of
+// a correct product, so the test is independent of the magnitude of the inputs.
+bool verifyFreivalds(const vector<vector<double>>& A, const vector<vector<double>>& B, const vector<vector<double>>& C,
+                     int rounds, double tolerance, double& max_residual, bool trans_a, bool trans_b) {
+    int N = trans_a ? A[0].size() : A.size();
+    int M = trans_a ? A.size() : A[0].size();
+    int P = trans_b ? B.size() : B[0].size();
+    
+    // Elements of op(A) and op(B), read in place when transposed
+    auto opA = [&](int i, int k) { return trans_a ? A[k][i] : A[i][k]; };
+    auto opB = [&](int k, int j) { return trans_b ? B[j][k] : B[k][j]; };
+    
+    mt19937_64 rng(random_device{}());
+    uniform_real_distribution<double> dist(-1.0, 1.0);
+    
+    vector<double> r(P), Br(M), Br_abs(M);
+    max_residual = 0.0;
+    
+    for (int round = 0; round < rounds; round++) {
+        for (int j = 0; j < P; j++) {
+            r[j] = dist(rng);
+        }
+        
+        // Br = B * r, along with the magnitude bound |B| * |r|
+        for (int k = 0; k < M; k++) {
+            double sum = 0.0, sum_abs = 0.0;
+            for (int j = 0; j < P; j++) {
+                sum += opB(k, j) * r[j];
+                sum_abs += fabs(opB(k, j) * r[j]);
+            }
+            Br[k] = sum;
+            Br_abs[k] = sum_abs;
+        }
+        
+        for (int i = 0; i < N; i++) {
+            double ABr = 0.0, bound = 0.0;
+            for (int k = 0; k < M; k++) {
+                ABr += opA(i, k) * Br[k];
+                bound += fabs(opA(i, k)) * Br_abs[k];
+            }
+            
+            double Cr = 0.0;
+            for (int j = 0; j < P; j++) {
+                Cr += C[i][j] * r[j];
+            }
+            
+            double residual = fabs(ABr - Cr) / max(bound, numeric_limits<double>::min());
+            if (!(residual <= tolerance)) {
+                // NaN residuals are failures too
+                max_residual = isnan(residual) ? residual : max(max_residual, residual);
+                return false;
+            }
+            max_residual = max(max_residual, residual);
+        }
+    }
+    
+    return true;
+}
+
+// Function to parse a kernel name given to --kernel
+bool parseKernelName(const string& name, KernelType& kernel) {
+    for (int k = KERNEL_NAIVE; k <= KERNEL_TILED; k++) {
+        if (name == KERNEL_NAMES[k]) {
+            kernel = static_cast<KernelType>(k);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to parse tile sizes given as <rows>x<cols>x<depth>
+bool parseTileSizes(const string& spec, KernelConfig& config) {
+    int rows, cols, depth;
+    char x1, x2;
+    istringstream iss(spec);
+    if (!(iss >> rows >> x1 >> cols >> x2 >> depth) || x1 != 'x' || x2 != 'x' || !iss.eof()) {
+        return false;
+    }
+    if (rows <= 0 || cols <= 0 || depth <= 0) {
+        return false;
+    }
+    config.tile_rows = rows;
+    config.tile_cols = cols;
+    config.tile_depth = depth;
+    return true;
+}
+
+// Function to describe a kernel configuration for logs
+string describeKernel(const KernelConfig& config) {
+    string description = KERNEL_NAMES[config.kernel];
+    if (config.kernel == KERNEL_TILED) {
+        description += " (" + to_string(config.tile_rows) + "x" + to_string(config.tile_cols) +
+                       "x" + to_string(config.tile_depth) + ")";
+    }
+    return description;
+}
+
+// Function to get the name of this host, used to key tuning profiles
+string hostName() {
+    char name[256];
+    if (gethostname(name, sizeof(name)) != 0) {
+        return "unknown";
+    }
+    name[sizeof(name) - 1] = '\0';
+    return name;
+}
+
+// Function to bucket a shape into a class: each dimension rounded up to a power of two
+string shapeClass(int N, int M, int P) {
+    auto bucket = [](int x) {
+        int b = 1;
+        while (b < x) b <<= 1;
+        return b;
+    };
+    return "n" + to_string(bucket(N)) + "_m" + to_string(bucket(M)) + "_p" + to_string(bucket(P));
+}
+
+// Function to get the tuning file path: $MATRIX_MUL_TUNE_FILE, else ~/.matrix_mul_tune
+string defaultTuningFile() {
+    const char* path = getenv("MATRIX_MUL_TUNE_FILE");
+    if (path != nullptr && *path != '\0') {
+        return path;
+    }
+    const char* home = getenv("HOME");
+    return string(home != nullptr ? home : ".") + "/.matrix_mul_tune";
+}
+
+// Function to load all entries of a tuning file. A missing file has no entries.
+// Each line is: <host> <shape_class> <processes> <kernel> <tile_rows> <tile_cols> <tile_depth> <seconds>
+vector<TuningEntry> loadTuningFile(const string& path) {
+    vector<TuningEntry> entries;
+    ifstream file(path);
+    string line;
+    while (getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        istringstream iss(line);
+        TuningEntry entry;
+        string kernel;
+        if (!(iss >> entry.host >> entry.shape_class >> entry.num_processes >> kernel >> entry.config.tile_rows
+                  >> entry.config.tile_cols >> entry.config.tile_depth >> entry.seconds) ||
+            !parseKernelName(kernel, entry.config.kernel) || entry.num_processes <= 0) {
+            cerr << "Warning: Ignoring malformed line in " << path << ": " << line << endl;
+            continue;
+        }
+        entries.push_back(entry);
+    }
+    return entries;
+}
+
+// Function to find the tuned configuration for this host whose shape class is
+// closest to N x M x P (distance measured in powers of two)
+bool lookupTuning(const string& path, int N, int M, int P, TuningEntry& entry) {
+    string host = hostName();
+    int n_class, m_class, p_class;
+    sscanf(shapeClass(N, M, P).c_str(), "n%d_m%d_p%d", &n_class, &m_class, &p_class);
+    
+    double best_distance = numeric_limits<double>::infinity();
+    for (const TuningEntry& candidate : loadTuningFile(path)) {
+        int n, m, p;
+        if (candidate.host != host || sscanf(candidate.shape_class.c_str(), "n%d_m%d_p%d", &n, &m, &p) != 3) {
+            continue;
+        }
+        double distance = fabs(log2((double)n / n_class)) + fabs(log2((double)m / m_class)) +
+                          fabs(log2((double)p / p_class));
+        if (distance < best_distance) {
+            best_distance = distance;
+            entry = candidate;
+        }
+    }
+    return best_distance < numeric_limits<double>::infinity();
+}
+
+// Function to store a tuned configuration, replacing the one for the same host and shape class
+void saveTuningEntry(const string& path, const TuningEntry& entry) {
+    vector<TuningEntry> entries = loadTuningFile(path);
+    bool replaced = false;
+    for (TuningEntry& existing : entries) {
+        if (existing.host == entry.host && existing.shape_class == entry.shape_class) {
+            existing = entry;
+            replaced = true;
+        }
+    }
+    if (!replaced) {
+        entries.push_back(entry);
+    }
+    
+    // Write to a temporary file and rename it, so concurrent readers never see a partial file
+    string tmp_path = path + ".tmp." + to_string(getpid());
+    ofstream file(tmp_path);
+    if (!file.is_open()) {
+        cerr << "Warning: Could not write tuning file: " << path << endl;
+        return;
+    }
+    file << "# host shape_class processes kernel tile_rows tile_cols tile_depth seconds" << endl;
+    for (const TuningEntry& e : entries) {
+        file << e.host << " " << e.shape_class << " " << e.num_processes << " " << KERNEL_NAMES[e.config.kernel]
+             << " " << e.config.tile_rows << " " << e.config.tile_cols << " " << e.config.tile_depth
+             << " " << scientific << setprecision(6) << e.seconds << endl;
+    }
+    file.close();
+    if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+        cerr << "Warning: Could not write tuning file: " << path << ": " << strerror(errno) << endl;
+        unlink(tmp_path.c_str());
+    }
+}
+
+// Function to get the size in bytes of a data cache level (1, 2 or 3), 0 if unknown
+long probeCacheSize(int level) {
+    long size = 0;
+    switch (level) {
+        case 1: size = sysconf(_SC_LEVEL1_DCACHE_SIZE); break;
+        case 2: size = sysconf(_SC_LEVEL2_CACHE_SIZE); break;
+        case 3: size = sysconf(_SC_LEVEL3_CACHE_SIZE); break;
+    }
+    if (size > 0) {
+        return size;
+    }
+    
+    // Fall back to sysfs, which reports sizes such as "32K"
+    for (int index = 0; index < 8; index++) {
+        string dir = "/sys/devices/system/cpu/cpu0/cache/index" + to_string(index) + "/";
+        ifstream level_file(dir + "level"), type_file(dir + "type"), size_file(dir + "size");
+        int cache_level;
+        string type, size_text;
+        if (!(level_file >> cache_level) || !(type_file >> type) || !(size_file >> size_text)) {
+            break;
+        }
+        if (cache_level != level || type == "Instruction") continue;
+        size = atol(size_text.c_str());
+        if (size_text.back() == 'K') size *= 1024;
+        if (size_text.back() == 'M') size *= 1024 * 1024;
+        return size;
+    }
+    return 0;
+}
+
+// Child process function of the tuner: once per round, wait until the parent
+// releases the round, run the kernel over rows [start_row, end_row) and
+// record when it finished
+void calculateTunedPortion(void* matrixA, void* matrixB, void* matrixC, SharedTuneData* tune, int index,
+                           int start_row, int end_row, const KernelConfig& config) {
+    for (int r = 0; r < tune->rounds; r++) {
+        tune->waiting.fetch_add(1, memory_order_acq_rel);
+        futexWake(&tune->waiting);
+        
+        int round = tune->round.load(memory_order_acquire);
+        while (round <= r) {
+            futexWait(&tune->round, round);
+            round = tune->round.load(memory_order_acquire);
+        }
+        if (round == TUNE_ABORTED) break;
+        
+        calculateMatrixPortion(matrixA, matrixB, matrixC, start_row, end_row, config);
+        tune->end_ns[r][index] = traceNow();
+    }
+}
+
+// Function to time the kernel on the sample in shared memory with
+// num_processes workers. The workers are created before the clock starts and
+// run TUNE_REPEATS rounds; the best round, from its release to the last worker
+// finishing, is returned.
+double measureKernel(void* shm_A, void* shm_B, void* shm_C, void* shm_tune, int rows, int num_processes,
+                     const KernelConfig& config) {
+    SharedTuneData* tune = new (shm_tune) SharedTuneData();
+    tune->waiting.store(0, memory_order_relaxed);
+    tune->round.store(0, memory_order_relaxed);
+    tune->rounds = TUNE_REPEATS;
+    
+    vector<WorkerTask> tasks;
+    for (int i = 0; i < num_processes; i++) {
+        int start_row, end_row;
+        blockRange(rows, num_processes, i, start_row, end_row);
+        tasks.push_back({WORKER_TUNE, i, start_row, end_row});
+    }
+    
+    vector<pid_t> child_pids;
+    bool succeeded = spawnWorkers(tasks, {shm_A, shm_B, shm_C, shm_tune}, config, child_pids);
+    uint64_t start_ns[TUNE_REPEATS];
+    for (int r = 0; r < TUNE_REPEATS && succeeded; r++) {
+        succeeded = waitForCount(&tune->waiting, (r + 1) * num_processes, child_pids);
+        start_ns[r] = traceNow();
+        tune->round.store(r + 1, memory_order_release);
+        futexWake(&tune->round);
+    }
+    if (!succeeded) {
+        tune->round.store(TUNE_ABORTED);
+        futexWake(&tune->round);
+    }
+    if (!waitWorkers(child_pids) || !succeeded) {
+        return -1.0;
+    }
+    
+    double best = numeric_limits<double>::infinity();
+    for (int r = 0; r < TUNE_REPEATS; r++) {
+        uint64_t end_ns = *max_element(tune->end_ns[r], tune->end_ns[r] + num_processes);
+        best = min(best, (double)(end_ns - start_ns[r]) / 1e9);
+    }
+    return best;
+}
+
+// Function to pick the process count, kernel and tile sizes for the shape of A x B.
+// Kernels are compared first with one process per core, then the process count
+// is swept with the winning kernel. Measurements run on a sample of the rows of
+// A sized to about TUNE_PROBE_WORK multiply-adds, which is copied to shared
+// memory once; only the kernel inside already created workers is timed.
+TuningEntry tuneConfiguration(const vector<vector<double>>& A, const vector<vector<double>>& B) {
+    int N = A.size();
+    int M = A[0].size();
+    int P = B[0].size();
+    
+    int cores = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    long l1 = probeCacheSize(1), l2 = probeCacheSize(2), l3 = probeCacheSize(3);
+    if (l1 <= 0) l1 = 32 * 1024;
+    if (l2 <= 0) l2 = 256 * 1024;
+    
+    cout << "Tuning: " << cores << " cores, L1d " << l1 / 1024 << " KiB, L2 " << l2 / 1024 << " KiB";
+    if (l3 > 0) cout << ", L3 " << l3 / 1024 << " KiB";
+    cout << endl;
+    
+    // Process counts: powers of two up to twice the core count, plus the core count itself
+    int max_processes = min({N, 2 * cores, MAX_AUTO_PROCESSES});
+    vector<int> process_counts;
+    for (int n = 1; n <= max_processes; n *= 2) {
+        process_counts.push_back(n);
+    }
+    if (cores <= max_processes && find(process_counts.begin(), process_counts.end(), cores) == process_counts.end()) {
+        process_counts.push_back(cores);
+    }
+    sort(process_counts.begin(), process_counts.end());
+    
+    // Sample enough rows for a measurable run with every worker getting a few rows
+    long sample_rows = TUNE_PROBE_WORK / max(1L, (long)M * P);
+    sample_rows = max<long>(sample_rows, 4L * max_processes);
+    sample_rows = min<long>(sample_rows, N);
+    vector<vector<double>> A_sample(A.begin(), A.begin() + sample_rows);
+    
+    // Kernel candidates. Tiles keep a tile_depth x tile_cols block of B within
+    // half of L2, and a tile_rows x tile_depth block of A within half of L1.
+    vector<KernelConfig> kernels(2);
+    kernels[0].kernel = KERNEL_NAIVE;
+    kernels[1].kernel = KERNEL_IKJ;
+    const int depths[] = {64, 128, 256};
+    const int widths[] = {128, 256, 512};
+    for (int depth : depths) {
+        for (int width : widths) {
+            if ((size_t)depth * width * sizeof(double) > (size_t)l2 / 2) continue;
+            if (depth > 2 * M || width > 2 * P) continue;
+            KernelConfig config;
+            config.kernel = KERNEL_TILED;
+            config.tile_depth = depth;
+            config.tile_cols = width;
+            config.tile_rows = (int)max(4L, (long)(l1 / 2 / (depth * sizeof(double))));
+            kernels.push_back(config);
+        }
+    }
+    
+    void* shm_A = createSharedMatrix(A_sample, shmName("A"));
+    void* shm_B = createSharedMatrix(B, shmName("B"));
+    void* shm_C = createEmptySharedMatrix(sample_rows, P, shmName("C"));
+    void* shm_tune = createSharedSegment(shmName("tune"), sizeof(SharedTuneData));
+    size_t A_size = sizeof(SharedMatrixData) + (size_t)sample_rows * M * sizeof(double);
+    size_t B_size = sizeof(SharedMatrixData) + (size_t)M * P * sizeof(double);
+    size_t C_size = sizeof(SharedMatrixData) + (size_t)sample_rows * P * sizeof(double);
+    auto cleanup = [&]() {
+        cleanupSharedMemory(shmName("A"), shm_A, A_size);
+        cleanupSharedMemory(shmName("B"), shm_B, B_size);
+        cleanupSharedMemory(shmName("C"), shm_C, C_size);
+        cleanupSharedMemory(shmName("tune"), shm_tune, sizeof(SharedTuneData));
+    };
+    
+    auto measure = [&](int num_processes, const KernelConfig& config) {
+        double best = measureKernel(shm_A, shm_B, shm_C, shm_tune, sample_rows, num_processes, config);
+        if (best < 0) {
+            cerr << "Error: A worker process failed" << endl;
+            cleanup();
+            exit(1);
+        }
+        cout << "Tuning: " << num_processes << " processes, kernel " << describeKernel(config)
+             << ": " << fixed << setprecision(6) << best << " seconds" << endl;
+        return best;
+    };
+    
+    TuningEntry entry;
+    entry.host = hostName();
+    entry.shape_class = shapeClass(N, M, P);
+    entry.num_processes = min(cores, max_processes);
+    entry.seconds = numeric_limits<double>::infinity();
+    
+    for (const KernelConfig& config : kernels) {
+        double seconds = measure(entry.num_processes, config);
+        if (seconds < entry.seconds) {
+            entry.seconds = seconds;
+            entry.config = config;
+        }
+    }
+    
+    for (int num_processes : process_counts) {
+        if (num_processes == entry.num_processes) continue;
+        double seconds = measure(num_processes, entry.config);
+        if (seconds < entry.seconds) {
+            entry.seconds = seconds;
+            entry.num_processes = num_processes;
+        }
+    }
+    
+    cleanup();
+    return entry;
+}
+
+// Function to fingerprint a matrix: its dimensions followed by its values
+uint64_t hashMatrix(const vector<vector<double>>& matrix) {
+    XXH64 state;
+    int64_t dims[2] = {(int64_t)matrix.size(), (int64_t)matrix[0].size()};
+    state.update(dims, sizeof(dims));
+    for (const vector<double>& row : matrix) {
+        state.update(row.data(), row.size() * sizeof(double));
+    }
+    return state.digest();
+}
+
+// Function to get the cache directory: $MATRIX_MUL_CACHE_DIR, else $XDG_CACHE_HOME/matrix_mul, else ~/.cache/matrix_mul
+string defaultCacheDir() {
+    const char* dir = getenv("MATRIX_MUL_CACHE_DIR");
+    if (dir != nullptr && *dir != '\0') {
+        return dir;
+    }
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    if (xdg != nullptr && *xdg != '\0') {
+        return string(xdg) + "/matrix_mul";
+    }
+    const char* home = getenv("HOME");
+    return string(home != nullptr ? home : ".") + "/.cache/matrix_mul";
+}
+
+// Function to build the cache key of A x B from the fingerprints of both inputs
+string cacheKey(uint64_t hashA, uint64_t hashB, bool trans_a, bool trans_b) {
+    char key[48];
+    snprintf(key, sizeof(key), "%016llx-%016llx%s%s", (unsigned long long)hashA, (unsigned long long)hashB,
+             trans_a ? "-tA" : "", trans_b ? "-tB" : "");
+    return key;
+}
+
+// Function to take the cache directory lock (LOCK_SH or LOCK_EX). Returns the
+// lock file descriptor, or -1 if the cache cannot be used. Closing the
+// descriptor releases the lock.
+int lockCacheDir(const string& dir, int operation) {
+    error_code ec;
+    fs::create_directories(dir, ec);
+    
+    int fd = open((dir + "/.lock").c_str(), O_CREAT | O_RDWR, 0666);
+    if (fd == -1) {
+        cerr << "Warning: Could not open cache lock in " << dir << ": " << strerror(errno) << endl;
+        return -1;
+    }
+    while (flock(fd, operation) == -1) {
+        if (errno != EINTR) {
+            cerr << "Warning: Could not lock cache " << dir << ": " << strerror(errno) << endl;
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+// Function to load a cached result. On a hit the entry becomes the most recently used.
+bool cacheLookup(const string& dir, const string& key, int N, int P, vector<vector<double>>& C) {
+    int lock_fd = lockCacheDir(dir, LOCK_SH);
+    if (lock_fd == -1) return false;
+    
+    string path = dir + "/" + key + ".bin";
+    MatrixStreamReader reader;
+    bool hit = false;
+    if (reader.open(path) && reader.isBinary() && reader.totalRows() == N && reader.cols() == P) {
+        C.assign(N, vector<double>());
+        hit = true;
+        for (int i = 0; i < N && hit; i++) {
+            hit = reader.readRows(C[i], 1) == 1;
+        }
+        if (hit) {
+            // Recency for LRU eviction is the modification time
+            utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+        } else {
+            cerr << "Warning: Ignoring corrupt cache entry " << path << endl;
+            C.clear();
+        }
+    }
+    
+    close(lock_fd);
+    return hit;
+}
+
+// Function to add a result to the cache and evict least recently used entries
+// until the cache fits in max_bytes. The entry is written to a private file
+// first and renamed into place under the exclusive lock, so other processes
+// never observe a partial entry.
+bool cacheStore(const string& dir, const string& key, const vector<vector<double>>& C, long max_bytes, int& evicted) {
+    evicted = 0;
+    long entry_bytes = sizeof(BinaryMatrixHeader) + (long)C.size() * C[0].size() * sizeof(double);
+    if (entry_bytes > max_bytes) {
+        return false;
+    }
+    
+    error_code ec;
+    fs::create_directories(dir, ec);
+    string tmp_path = dir + "/.tmp." + to_string(getpid()) + "." + key;
+    if (!writeBinaryMatrix(tmp_path, C)) {
+        cerr << "Warning: Could not write cache entry in " << dir << endl;
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    
+    int lock_fd = lockCacheDir(dir, LOCK_EX);
+    if (lock_fd == -1) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    
+    string path = dir + "/" + key + ".bin";
+    bool stored = rename(tmp_path.c_str(), path.c_str()) == 0;
+    if (!stored) {
+        cerr << "Warning: Could not store cache entry " << path << ": " << strerror(errno) << endl;
+        unlink(tmp_path.c_str());
+    }
+    
+    // Evict the oldest entries until the cache fits
+    vector<pair<fs::file_time_type, fs::path>> entries;
+    long total_bytes = 0;
+    for (const fs::directory_entry& entry : fs::directory_iterator(dir, ec)) {
+        if (entry.path().extension() != ".bin" || !entry.is_regular_file(ec)) continue;
+        total_bytes += entry.file_size(ec);
+        entries.emplace_back(entry.last_write_time(ec), entry.path());
+    }
+    sort(entries.begin(), entries.end());
+    for (const auto& entry : entries) {
+        if (total_bytes <= max_bytes) break;
+        if (entry.second == fs::path(path)) continue;
+        long size = fs::file_size(entry.second, ec);
+        if (fs::remove(entry.second, ec)) {
+            total_bytes -= size;
+            evicted++;
+        }
+    }
+    
+    close(lock_fd);
+    return stored;
+}
+
+// Function to parse a spawn strategy given to --spawn
+bool parseSpawnStrategy(const string& name, SpawnStrategy& strategy) {
+    for (int k = SPAWN_FORK; k <= SPAWN_CLONE; k++) {
+        if (name == SPAWN_NAMES[k]) {
+            strategy = static_cast<SpawnStrategy>(k);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function run by every worker process, whatever the spawn strategy
+void runWorker(const WorkerTask& task, const WorkerSegments& segments, const KernelConfig& config) {
+    // A worker blocked on a futex would outlive a parent killed before it
+    // could stop it, so it dies with the parent (vforkExec sets this up before
+    // exec for the other workers)
+    if (g_spawn_parent != 0) {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() != g_spawn_parent) {
+            _exit(1);
+        }
+    }
+    for (int fd : g_summa_sockets) {
+        if (fd != -1) close(fd);
+    }
+    
+    if (g_spawn_times != nullptr) {
+        g_spawn_times[task.slot] = traceNow();
+    }
+    TraceRing* ring = currentTraceRing();
+    if (g_trace != nullptr && ring != nullptr) {
+        ring->pid = getpid();
+    }
+    
+    traceEvent(PHASE_WORKER, 'B', task.start, task.end);
+    switch (task.kind) {
+        case WORKER_ROWS:
+            calculateMatrixPortion(segments.A, segments.B, segments.C, task.start, task.end, config);
+            break;
+        case WORKER_DELTA:
+            calculateDeltaPortion(segments.A, segments.B, segments.C, segments.aux, task.start, task.end, config);
+            break;
+        case WORKER_PIPELINE:
+            calculatePipelinedPortion(segments.A, segments.B, segments.C,
+                                      static_cast<SharedPipelineData*>(segments.aux), config);
+            break;
+        case WORKER_FAST_PATH:
+            calculateFastPathPortion(segments.A, segments.B, segments.C, static_cast<SharedFastPathData*>(segments.aux),
+                                     task.index, task.start, task.end, config);
+            break;
+        case WORKER_SUMMA:
+            calculateSummaPortion(segments.A, segments.B, segments.C, static_cast<SharedSummaData*>(segments.aux),
+                                  task.start, task.end, config);
+            break;
+        case WORKER_TUNE:
+            calculateTunedPortion(segments.A, segments.B, segments.C, static_cast<SharedTuneData*>(segments.aux),
+                                  task.index, task.start, task.end, config);
+            break;
+    }
+    traceEvent(PHASE_WORKER, 'E', task.start, task.end);
+}
+
+// Entry point of clone workers. Returning ends the process.
+//
+// Clone workers share the address space of the parent but are not threads to
+// glibc: they run on the parent's thread pointer, so they share its errno, its
+// malloc arenas and the locks of its streams, all of which the parent (and the
+// SUMMA comm thread) keeps using while they run. Everything a clone worker
+// touches must therefore be reserved by spawnWorkers: buffers come from
+// workerScratch, futex calls go through rawFutex, and workers neither
+// allocate, print nor call library functions that set errno.
+int cloneWorkerEntry(void* arg) {
+    CloneWorker* worker = static_cast<CloneWorker*>(arg);
+    runWorker(worker->task, worker->segments, worker->config);
+    return 0;
+}
+
+// Function to get the number of doubles of scratch memory a worker needs for
+// its task, so that spawnWorkers can reserve it for clone workers
+size_t workerScratchCount(const WorkerTask& task, const WorkerSegments& segments, const KernelConfig& config) {
+    if (task.end <= task.start) {
+        return 0;
+    }
+    switch (task.kind) {
+        case WORKER_ROWS:
+        case WORKER_TUNE:
+            // Blocks of rows of A^T are packed (calculateMatrixRows)
+            if (config.trans_a) {
+                int N, M, P;
+                operandShapes(segments.A, segments.B, config, N, M, P);
+                return (size_t)min(rowBlockRows(M, P), task.end - task.start) * M;
+            }
+            return 0;
+        case WORKER_SUMMA:
+            // Panel products of the rows of the worker (calculateSummaPortion)
+            return (size_t)(task.end - task.start) * static_cast<SharedSummaData*>(segments.aux)->n_cols;
+        default:
+            return 0;
+    }
+}
+
+// Function to get a scratch buffer of count doubles. Clone workers get the
+// buffer spawnWorkers reserved in their slot; other processes allocate it in
+// fallback, which must outlive the use of the buffer.
+double* workerScratch(size_t count, vector<double>& fallback) {
+    CloneWorker* worker = currentCloneWorker();
+    if (worker == nullptr) {
+        fallback.resize(count);
+        return fallback.data();
+    }
+    if (count > worker->scratch_count) {
+        // workerScratchCount is out of step with the kernels; fail the worker
+        // instead of writing past the slot
+        _exit(1);
+    }
+    return worker->scratch;
+}
+
+// Function to start this program as a worker with vfork and exec. It is kept
+// out of line so that the child shares no locals with the spawn loop.
+__attribute__((noinline)) pid_t vforkExec(char* const* argv) {
+    pid_t pid = vfork();
+    if (pid == 0) {
+        // Only plain system calls, exec and _exit are allowed in a vfork
+        // child. The death signal is kept across exec, and the parent is
+        // suspended until then, so its death cannot be missed.
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+// Function to start one worker process per task with the selected strategy.
+// Stacks and timestamps are indexed by the position of the task in tasks,
+// which is also its slot. Returns false if a worker could not be created; the
+// pids of the workers that were started are in child_pids either way.
+bool spawnWorkers(const vector<WorkerTask>& tasks, const WorkerSegments& segments, const KernelConfig& config,
+                  vector<pid_t>& child_pids) {
+    int n = tasks.size();
+    
+    // Slots for the start timestamps written by the workers
+    if (g_spawn_capacity < n) {
+        if (g_spawn_times != nullptr) {
+            cleanupSharedMemory(shmName("spawn"), g_spawn_times, g_spawn_capacity * sizeof(uint64_t));
+        }
+        g_spawn_capacity = max(n, 64);
+        g_spawn_times = static_cast<uint64_t*>(createSharedSegment(shmName("spawn"), g_spawn_capacity * sizeof(uint64_t)));
+    }
+    fill(g_spawn_times, g_spawn_times + g_spawn_capacity, 0);
+    g_spawn_issued.assign(g_spawn_capacity, 0);
+    g_spawn_returned.assign(g_spawn_capacity, 0);
+    
+    // Everything a vfork child needs must be prepared before vfork
+    string exe_path = "/proc/self/exe";
+    if (g_spawn_strategy == SPAWN_VFORK) {
+        char path[4096];
+        ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+        if (len > 0) {
+            exe_path.assign(path, len);
+        }
+    }
+    
+    if (g_spawn_strategy == SPAWN_CLONE) {
+        // Every slot gets room for the largest scratch buffer after its stack
+        size_t scratch_count = 0;
+        for (const WorkerTask& task : tasks) {
+            scratch_count = max(scratch_count, workerScratchCount(task, segments, config));
+        }
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t scratch_bytes = (scratch_count * sizeof(double) + page - 1) / page * page;
+        g_clone_slot_size = CLONE_STACK_SIZE + scratch_bytes;
+        g_clone_stacks_size = n * g_clone_slot_size;
+        void* stacks = mmap(0, g_clone_stacks_size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+        if (stacks == MAP_FAILED) {
+            cerr << "Error allocating worker stacks: " << strerror(errno) << endl;
+            g_clone_stacks_size = 0;
+            return false;
+        }
+        g_clone_stacks = static_cast<char*>(stacks);
+    }
+    
+    g_spawn_parent = getpid();
+    traceEvent(PHASE_SPAWN, 'B');
+    for (int slot = 0; slot < n; slot++) {
+        WorkerTask task = tasks[slot];
+        task.slot = slot;
+        pid_t pid = -1;
+        g_spawn_issued[slot] = traceNow();
+        
+        if (g_spawn_strategy == SPAWN_FORK) {
+            pid = fork();
+            if (pid == 0) {
+                // Child process
+                traceAttach(task.index + 1);
+                runWorker(task, segments, config);
+                
+                // Child process exits after calculation; _exit skips the parent's atexit handlers and stdio buffers
+                _exit(0);
+            }
+        } else if (g_spawn_strategy == SPAWN_VFORK) {
+            vector<string> args = {
+                exe_path, "--worker", to_string(task.kind), to_string(task.index), to_string(task.slot),
+                to_string(task.start), to_string(task.end), g_shm_prefix, to_string(config.kernel),
+                to_string(config.tile_rows), to_string(config.tile_cols), to_string(config.tile_depth),
+                to_string(config.trans_a), to_string(config.trans_b), to_string(g_trace != nullptr), to_string(g_prefault)
+            };
+            vector<char*> argv;
+            for (string& arg : args) {
+                argv.push_back(&arg[0]);
+            }
+            argv.push_back(nullptr);
+            
+            pid = vforkExec(argv.data());
+        } else {
+            CloneWorker* worker = reinterpret_cast<CloneWorker*>(g_clone_stacks + (size_t)slot * g_clone_slot_size);
+            worker->task = task;
+            worker->segments = segments;
+            worker->config = config;
+            worker->trace_ring = g_trace != nullptr && task.index + 1 < g_trace->n_rings
+                                 ? reinterpret_cast<TraceRing*>(g_trace + 1) + task.index + 1 : nullptr;
+            
+            // The stack grows down towards the CloneWorker at its bottom; the scratch buffer follows it
+            char* stack_top = reinterpret_cast<char*>(worker) + CLONE_STACK_SIZE;
+            worker->scratch = reinterpret_cast<double*>(stack_top);
+            worker->scratch_count = (g_clone_slot_size - CLONE_STACK_SIZE) / sizeof(double);
+            pid = clone(cloneWorkerEntry, stack_top, CLONE_VM | SIGCHLD, worker);
+        }
+        
+        g_spawn_returned[slot] = traceNow();
+        if (pid < 0) {
+            traceEvent(PHASE_SPAWN, 'E');
+            return false;
+        }
+        child_pids.push_back(pid);
+    }
+    traceEvent(PHASE_SPAWN, 'E');
+    return true;
+}
+
+// Function to wait for the workers and compute their spawn latencies. Returns
+// false if any worker did not exit successfully.
+bool waitWorkers(const vector<pid_t>& child_pids) {
+    bool succeeded = true;
+    
+    // Parent waits for all child processes to complete
+    traceEvent(PHASE_WAIT, 'B');
+    for (pid_t child_pid : child_pids) {
+        int status;
+        if (waitpid(child_pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            succeeded = false;
+        }
+    }
+    traceEvent(PHASE_WAIT, 'E');
+    
+    if (g_clone_stacks != nullptr) {
+        munmap(g_clone_stacks, g_clone_stacks_size);
+        g_clone_stacks = nullptr;
+        g_clone_stacks_size = 0;
+        g_clone_slot_size = 0;
+    }
+    
+    // Child latency: from the spawn call in the parent to the first instruction of the worker
+    SpawnStats stats;
+    double child_total = 0.0, parent_total = 0.0;
+    for (int i = 0; i < g_spawn_capacity; i++) {
+        if (g_spawn_issued[i] == 0 || g_spawn_times[i] == 0) continue;
+        double child_us = (double)(g_spawn_times[i] - g_spawn_issued[i]) / 1000.0;
+        double parent_us = (double)(g_spawn_returned[i] - g_spawn_issued[i]) / 1000.0;
+        child_total += child_us;
+        parent_total += parent_us;
+        stats.child_max_us = max(stats.child_max_us, child_us);
+        stats.workers++;
+    }
+    if (stats.workers > 0) {
+        stats.child_mean_us = child_total / stats.workers;
+        stats.parent_mean_us = parent_total / stats.workers;
+    }
+    g_spawn_stats = stats;
+    
+    return succeeded;
+}
+
+// Function to release the spawn timestamp segment
+void cleanupSpawnResources() {
+    if (g_spawn_times != nullptr) {
+        cleanupSharedMemory(shmName("spawn"), g_spawn_times, g_spawn_capacity * sizeof(uint64_t));
+        g_spawn_times = nullptr;
+        g_spawn_capacity = 0;
+    }
+}
+
+// Entry point of workers started with vfork + exec:
+// matrix_mul --worker <kind> <index> <slot> <start> <end> <shm_prefix> <kernel> <tile_rows> <tile_cols> <tile_depth>
+//                     <trans_a> <trans_b> <trace> <prefault>
+int workerMain(int argc, char* argv[]) {
+    if (argc != 16) {
+        cerr << "Error: Invalid worker arguments" << endl;
+        return 1;
+    }
+    
+    WorkerTask task;
+    task.kind = static_cast<WorkerKind>(atoi(argv[2]));
+    task.index = atoi(argv[3]);
+    task.slot = atoi(argv[4]);
+    task.start = atoi(argv[5]);
+    task.end = atoi(argv[6]);
+    g_shm_prefix = argv[7];
+    KernelConfig config;
+    config.kernel = static_cast<KernelType>(atoi(argv[8]));
+    config.tile_rows = atoi(argv[9]);
+    config.tile_cols = atoi(argv[10]);
+    config.tile_depth = atoi(argv[11]);
+    config.trans_a = atoi(argv[12]) != 0;
+    config.trans_b = atoi(argv[13]) != 0;
+    bool trace = atoi(argv[14]) != 0;
+    g_prefault = atoi(argv[15]) != 0;
+    
+    size_t size;
+    WorkerSegments segments;
+    segments.A = openSharedSegment(shmName("A"), size);
+    segments.B = openSharedSegment(shmName("B"), size);
+    segments.C = openSharedSegment(shmName("C"), size);
+    segments.aux = nullptr;
+    if (task.kind == WORKER_DELTA) {
+        segments.aux = openSharedSegment(shmName("delta"), size);
+    } else if (task.kind == WORKER_PIPELINE) {
+        segments.aux = openSharedSegment(shmName("pipeline"), size);
+    } else if (task.kind == WORKER_SUMMA) {
+        segments.aux = openSharedSegment(shmName("summa"), size);
+    } else if (task.kind == WORKER_TUNE) {
+        segments.aux = openSharedSegment(shmName("tune"), size);
+    } else if (task.kind == WORKER_FAST_PATH) {
+        segments.aux = openSharedSegment(shmName("fastpath"), size);
+    }
+    
+    g_spawn_times = static_cast<uint64_t*>(openSharedSegment(shmName("spawn"), size));
+    if (trace) {
+        g_trace = static_cast<TraceBuffer*>(openSharedSegment(shmName("trace"), size));
+        traceAttach(task.index + 1);
+    }
+    
+    runWorker(task, segments, config);
+    return 0;
+}
+
+// Set by SIGINT and SIGTERM to stop the daemon
+volatile sig_atomic_t g_daemon_stop = 0;
+
+// Function to close every descriptor except stdin, stdout, stderr and keep.
+// Pool workers are forked while clients are connected and must not hold their sockets open.
+void closeInheritedDescriptors(int keep) {
+    vector<int> fds;
+    error_code ec;
+    for (const auto& entry : fs::directory_iterator("/proc/self/fd", ec)) {
+        int fd = atoi(entry.path().filename().c_str());
+        if (fd > 2 && fd != keep) {
+            fds.push_back(fd);
+        }
+    }
+    for (int fd : fds) {
+        close(fd);
+    }
+}
+
+// Function to fork one pool worker connected to the daemon by a socket pair
+bool startDaemonWorker(const KernelConfig& config, DaemonWorker& worker) {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) == -1) {
+        cerr << "Error creating worker socket: " << strerror(errno) << endl;
+        return false;
+    }
+    
+    pid_t pid = fork();
+    if (pid < 0) {
+        cerr << "Error creating worker process: " << strerror(errno) << endl;
+        close(pair[0]);
+        close(pair[1]);
+        return false;
+    }
+    if (pid == 0) {
+        // Child process: the daemon handles the signals and stops the workers by closing their sockets
+        signal(SIGINT, SIG_IGN);
+        signal(SIGTERM, SIG_IGN);
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, nullptr);
+        closeInheritedDescriptors(pair[1]);
+        daemonWorkerLoop(pair[1], config);
+        _exit(0);
+    }
+    
+    close(pair[1]);
+    worker.pid = pid;
+    worker.sock = pair[0];
+    worker.job = -1;
+    return true;
+}
+
+// Function run by pool workers: map the buffers of each task, compute its rows of C and report back
+void daemonWorkerLoop(int sock, const KernelConfig& config) {
+    for (;;) {
+        DaemonTaskMessage task;
+        int fds[3];
+        int n_fds;
+        ssize_t got = matmulRecvMessage(sock, &task, sizeof(task), fds, 3, n_fds);
+        if (got <= 0) return;  // the daemon is shutting down
+        
+        DaemonTaskDone done;
+        done.job = task.job;
+        done.status = MATMUL_FAILED;
+        
+        // Only the validated part of each buffer is mapped; the daemon checked
+        // that the buffers cannot shrink, so the mappings cannot fault
+        void* segments[3];
+        size_t sizes[3];
+        int mapped = 0;
+        if (got == (ssize_t)sizeof(task) && n_fds == 3) {
+            long elements[3] = {(long)task.N * task.M, (long)task.M * task.P, (long)task.N * task.P};
+            for (; mapped < 3; mapped++) {
+                sizes[mapped] = sizeof(MatmulMatrixHeader) + elements[mapped] * sizeof(double);
+                struct stat st;
+                if (fstat(fds[mapped], &st) == -1 || (size_t)st.st_size < sizes[mapped]) break;
+                int prot = mapped == 2 ? PROT_READ | PROT_WRITE : PROT_READ;
+                segments[mapped] = mmap(0, sizes[mapped], prot, MAP_SHARED, fds[mapped], 0);
+                if (segments[mapped] == MAP_FAILED) break;
+            }
+        }
+        if (mapped == 3) {
+            auto data = [](void* segment) {
+                return reinterpret_cast<double*>(static_cast<char*>(segment) + sizeof(MatmulMatrixHeader));
+            };
+            calculateMatrixRows(data(segments[0]), data(segments[1]), data(segments[2]), task.N, task.M, task.P,
+                                task.start_row, task.end_row, config);
+            done.status = MATMUL_OK;
+        }
+        
+        for (int i = 0; i < mapped; i++) {
+            munmap(segments[i], sizes[i]);
+        }
+        for (int i = 0; i < n_fds; i++) {
+            close(fds[i]);
+        }
+        if (!matmulSendMessage(sock, &done, sizeof(done), nullptr, 0)) return;
+    }
+}
+
+// Function to read the header of a matrix buffer sent by a client and the size
+// of the buffer. The buffer must be sealed against shrinking, and inputs also
+// against writes, so that neither the size nor A and B change after the check.
+bool readJobHeader(int fd, bool input, MatmulMatrixHeader& header, size_t& size) {
+    int required = F_SEAL_SHRINK | (input ? F_SEAL_WRITE : 0);
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (seals == -1 || (seals & required) != required) return false;
+    
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(header)) return false;
+    if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) return false;
+    size = st.st_size;
+    return header.n_rows > 0 && header.n_cols > 0 &&
+           size >= sizeof(header) + (size_t)header.n_rows * header.n_cols * sizeof(double);
+}
+
+// Daemon mode: matrix_mul --daemon <socket> [-n workers] [--max-jobs k] [--max-queue q] [--kernel ...] [--tile ...]
+// Keeps a pool of forked workers and computes the jobs sent by clients
+// (matmul_client.h) over a Unix domain socket.
+int daemonMain(int argc, char* argv[]) {
+    static_assert(sizeof(MatmulMatrixHeader) == sizeof(SharedMatrixData), "matrix buffers must match shared segments");
+    
+    if (argc < 3) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    string socket_path = argv[2];
+    int num_workers = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    int max_jobs = DAEMON_DEFAULT_MAX_JOBS;
+    int max_queue = DAEMON_DEFAULT_MAX_QUEUE;
+    KernelConfig config;
+    
+    static struct option long_options[] = {
+        {"max-jobs", required_argument, 0, 'j'},
+        {"max-queue", required_argument, 0, 'q'},
+        {"kernel", required_argument, 0, 'k'},
+        {"tile", required_argument, 0, 'L'},
+        {0, 0, 0, 0}
+    };
+    
+    int opt;
+    while ((opt = getopt_long(argc - 2, argv + 2, "n:", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 'n':
+                num_workers = atoi(optarg);
+                if (num_workers <= 0) {
+                    cerr << "Error: Number of processes must be positive" << endl;
+                    return 1;
+                }
+                break;
+            case 'j':
+                max_jobs = atoi(optarg);
+                if (max_jobs <= 0) {
+                    cerr << "Error: Maximum number of concurrent jobs must be positive" << endl;
+                    return 1;
+                }
+                break;
+            case 'q':
+                max_queue = atoi(optarg);
+                if (max_queue < 0) {
+                    cerr << "Error: Maximum queue length cannot be negative" << endl;
+                    return 1;
+                }
+                break;
+            case 'k':
+                if (!parseKernelName(optarg, config.kernel)) {
+                    cerr << "Error: Unknown kernel: " << optarg << endl;
+                    return 1;
+                }
+                break;
+            case 'L':
+                if (!parseTileSizes(optarg, config)) {
+                    cerr << "Error: Tile sizes must be given as <rows>x<cols>x<depth>" << endl;
+                    return 1;
+                }
+                break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+    
+    // Refuse to take over the socket of a running daemon, but replace a stale one
+    MatmulClient probe;
+    if (probe.connect(socket_path)) {
+        cerr << "Error: A daemon is already listening on " << socket_path << endl;
+        return 1;
+    }
+    unlink(socket_path.c_str());
+    
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        cerr << "Error: Socket path too long: " << socket_path << endl;
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path.c_str());
+    
+    int listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1 || bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1 ||
+        listen(listen_fd, SOMAXCONN) == -1) {
+        cerr << "Error listening on " << socket_path << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    
+    // Signals are only delivered inside ppoll, so a stop request cannot be missed
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = [](int) { g_daemon_stop = 1; };
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    sigset_t blocked, poll_mask;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    sigprocmask(SIG_BLOCK, &blocked, &poll_mask);
+    sigdelset(&poll_mask, SIGINT);
+    sigdelset(&poll_mask, SIGTERM);
+    
+    // Warm pool, started once
+    vector<DaemonWorker> workers(num_workers);
+    for (DaemonWorker& worker : workers) {
+        if (!startDaemonWorker(config, worker)) {
+            return 1;
+        }
+    }
+    
+    cout << "Daemon listening on " << socket_path << ": " << num_workers << " workers (" << describeKernel(config)
+         << "), at most " << max_jobs << " concurrent jobs and " << max_queue << " queued" << endl;
+    
+    map<int, DaemonJob> jobs;
+    int next_job = 0;
+    int running = 0;
+    deque<int> admission;               // accepted jobs waiting for a running slot
+    deque<DaemonTaskMessage> tasks;     // row blocks of running jobs not yet sent to a worker
+    vector<int> clients;
+    DaemonStats stats;
+    
+    auto releaseJob = [&](int id) {
+        for (int fd : jobs[id].fds) {
+            close(fd);
+        }
+        jobs.erase(id);
+    };
+    
+    // Results are sent without blocking; a client that does not read them is disconnected
+    auto sendResult = [&](int client, uint64_t job_id, int32_t status, double queue_seconds, double compute_seconds) {
+        if (client < 0) return;
+        MatmulJobResult result;
+        memset(&result, 0, sizeof(result));
+        result.job_id = job_id;
+        result.status = status;
+        result.queue_seconds = queue_seconds;
+        result.compute_seconds = compute_seconds;
+        if (send(client, &result, sizeof(result), MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)sizeof(result)) {
+            shutdown(client, SHUT_RDWR);
+        }
+    };
+    
+    // Split a job into one row block per worker
+    auto startJob = [&](int id) {
+        DaemonJob& job = jobs[id];
+        int blocks = min(num_workers, job.N);
+        int rows_per_block = job.N / blocks;
+        int remaining_rows = job.N % blocks;
+        int start_row = 0;
+        for (int i = 0; i < blocks; i++) {
+            int end_row = start_row + rows_per_block + (i < remaining_rows ? 1 : 0);
+            tasks.push_back({id, start_row, end_row, job.N, job.M, job.P});
+            start_row = end_row;
+        }
+        job.pending_tasks = blocks;
+        running++;
+    };
+    
+    auto finishTask = [&](int id, bool succeeded) {
+        DaemonJob& job = jobs[id];
+        job.failed = job.failed || !succeeded;
+        if (--job.pending_tasks > 0) return;
+        
+        auto now = chrono::steady_clock::now();
+        double queue_seconds = chrono::duration<double>(job.started_at - job.arrived).count();
+        double compute_seconds = chrono::duration<double>(now - job.started_at).count();
+        sendResult(job.client, job.job_id, job.failed ? MATMUL_FAILED : MATMUL_OK, queue_seconds, compute_seconds);
+        if (job.failed) {
+            stats.failed++;
+        } else {
+            stats.completed++;
+        }
+        releaseJob(id);
+        running--;
+        
+        if (!admission.empty()) {
+            int next = admission.front();
+            admission.pop_front();
+            startJob(next);
+        }
+    };
+    
+    auto acceptJob = [&](int client, const MatmulJobRequest& request, ssize_t got, int* fds, int n_fds) {
+        MatmulMatrixHeader header[3];
+        size_t size[3];
+        bool valid = got == (ssize_t)sizeof(request) && request.magic == MATMUL_PROTOCOL_MAGIC &&
+                     request.version == MATMUL_PROTOCOL_VERSION && n_fds == 3;
+        for (int i = 0; valid && i < 3; i++) {
+            valid = readJobHeader(fds[i], i < 2, header[i], size[i]);
+        }
+        valid = valid && header[0].n_cols == header[1].n_rows && header[2].n_rows == header[0].n_rows &&
+                header[2].n_cols == header[1].n_cols;
+        
+        int32_t status = MATMUL_OK;
+        if (!valid) {
+            status = MATMUL_INVALID;
+            stats.invalid++;
+        } else if (running >= max_jobs && (int)admission.size() >= max_queue) {
+            status = MATMUL_REJECTED;
+            stats.rejected++;
+        }
+        if (status != MATMUL_OK) {
+            for (int i = 0; i < n_fds; i++) {
+                close(fds[i]);
+            }
+            sendResult(client, got >= (ssize_t)sizeof(request) ? request.job_id : 0, status, 0.0, 0.0);
+            return;
+        }
+        
+        int id = next_job++;
+        DaemonJob& job = jobs[id];
+        job.client = client;
+        job.job_id = request.job_id;
+        copy(fds, fds + 3, job.fds);
+        job.N = header[0].n_rows;
+        job.M = header[0].n_cols;
+        job.P = header[1].n_cols;
+        job.arrived = chrono::steady_clock::now();
+        if (running < max_jobs) {
+            startJob(id);
+        } else {
+            admission.push_back(id);
+        }
+    };
+    
+    auto dropClient = [&](int client) {
+        close(client);
+        clients.erase(find(clients.begin(), clients.end(), client));
+        
+        // Jobs that did not start are discarded, the others finish without a reply
+        for (auto it = admission.begin(); it != admission.end();) {
+            if (jobs[*it].client == client) {
+                releaseJob(*it);
+                it = admission.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (auto& [id, job] : jobs) {
+            if (job.client == client) {
+                job.client = -1;
+            }
+        }
+    };
+    
+    while (!g_daemon_stop) {
+        // Hand queued row blocks to idle workers
+        for (DaemonWorker& worker : workers) {
+            if (tasks.empty()) break;
+            if (worker.job != -1) continue;
+            DaemonTaskMessage task = tasks.front();
+            tasks.pop_front();
+            DaemonJob& job = jobs[task.job];
+            if (!job.started) {
+                job.started = true;
+                job.started_at = chrono::steady_clock::now();
+            }
+            worker.job = task.job;
+            if (!matmulSendMessage(worker.sock, &task, sizeof(task), job.fds, 3)) {
+                // The worker is gone; its hang-up is handled below
+                tasks.push_front(task);
+                worker.job = -1;
+                break;
+            }
+        }
+        
+        vector<pollfd> fds;
+        fds.push_back({listen_fd, POLLIN, 0});
+        for (const DaemonWorker& worker : workers) {
+            fds.push_back({worker.sock, POLLIN, 0});
+        }
+        for (int client : clients) {
+            fds.push_back({client, POLLIN, 0});
+        }
+        
+        if (ppoll(fds.data(), fds.size(), nullptr, &poll_mask) == -1) {
+            if (errno == EINTR) continue;
+            cerr << "Error waiting for events: " << strerror(errno) << endl;
+            break;
+        }
+        
+        if (fds[0].revents & POLLIN) {
+            int client = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client != -1) {
+                clients.push_back(client);
+            }
+        }
+        
+        for (int i = 0; i < num_workers; i++) {
+            short revents = fds[1 + i].revents;
+            if (revents == 0) continue;
+            DaemonWorker& worker = workers[i];
+            DaemonTaskDone done;
+            int n_fds;
+            ssize_t got = (revents & POLLIN) ? matmulRecvMessage(worker.sock, &done, sizeof(done), nullptr, 0, n_fds) : 0;
+            if (got == (ssize_t)sizeof(done)) {
+                worker.job = -1;
+                finishTask(done.job, done.status == MATMUL_OK);
+                continue;
+            }
+            
+            // The worker died: fail its task and replace it to keep the pool size
+            int job = worker.job;
+            close(worker.sock);
+            waitpid(worker.pid, nullptr, 0);
+            cerr << "Warning: Worker process " << worker.pid << " exited unexpectedly, restarting it" << endl;
+            if (!startDaemonWorker(config, worker)) {
+                g_daemon_stop = 1;
+            }
+            if (job != -1) {
+                finishTask(job, false);
+            }
+        }
+        
+        for (size_t i = 1 + num_workers; i < fds.size(); i++) {
+            if (fds[i].revents == 0) continue;
+            int client = fds[i].fd;
+            MatmulJobRequest request;
+            int job_fds[3];
+            int n_fds;
+            ssize_t got = (fds[i].revents & POLLIN)
+                          ? matmulRecvMessage(client, &request, sizeof(request), job_fds, 3, n_fds) : 0;
+            if (got <= 0) {
+                dropClient(client);
+            } else {
+                acceptJob(client, request, got, job_fds, n_fds);
+            }
+        }
+    }
+    
+    // Stop accepting jobs, then let the workers finish their task and exit
+    close(listen_fd);
+    unlink(socket_path.c_str());
+    for (DaemonWorker& worker : workers) {
+        close(worker.sock);
+    }
+    for (DaemonWorker& worker : workers) {
+        waitpid(worker.pid, nullptr, 0);
+    }
+    for (int client : clients) {
+        close(client);
+    }
+    for (auto& [id, job] : jobs) {
+        for (int fd : job.fds) {
+            close(fd);
+        }
+    }
+    
+    cout << "Daemon stopped: " << stats.completed << " jobs completed, " << stats.rejected << " rejected, "
+         << stats.invalid << " invalid, " << stats.failed << " failed" << endl;
+    return 0;
+}
+
+// Function to split n items into parts nearly equal blocks and get the range of one of them
+void blockRange(int n, int parts, int index, int& begin, int& end) {
+    int base = n / parts;
+    int extra = n % parts;
+    begin = index * base + min(index, extra);
+    end = begin + base + (index < extra ? 1 : 0);
+}
+
+// Function to parse a process grid given as <rows>x<cols>
+bool parseGridShape(const string& spec, SummaGrid& grid) {
+    if (sscanf(spec.c_str(), "%dx%d", &grid.rows, &grid.cols) != 2) return false;
+    return grid.rows > 0 && grid.cols > 0;
+}
+
+// Function to parse a comma separated list of host:port addresses, one per rank
+bool parsePeers(const string& list, vector<string>& peers) {
+    stringstream ss(list);
+    string peer;
+    while (getline(ss, peer, ',')) {
+        if (peer.rfind(':') == string::npos) return false;
+        peers.push_back(peer);
+    }
+    return !peers.empty();
+}
+
+// Function to send a whole buffer over a socket. Returns false on failure.
+bool sendAll(int sock, const void* data, size_t bytes) {
+    const char* p = static_cast<const char*>(data);
+    while (bytes > 0) {
+        ssize_t sent = send(sock, p, bytes, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) {
+            cerr << "Error sending to peer: " << strerror(errno) << endl;
+            return false;
+        }
+        p += sent;
+        bytes -= sent;
+    }
+    return true;
+}
+
+// Function to receive a whole buffer from a socket. Returns false on failure.
+bool recvAll(int sock, void* data, size_t bytes) {
+    char* p = static_cast<char*>(data);
+    while (bytes > 0) {
+        ssize_t got = recv(sock, p, bytes, 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            cerr << "Error receiving from peer: " << (got == 0 ? "connection closed" : strerror(errno)) << endl;
+            return false;
+        }
+        p += got;
+        bytes -= got;
+    }
+    return true;
+}
+
+// Function to open the listening socket of a rank on the port of its address
+int listenSummaPort(const string& address) {
+    int port = atoi(address.substr(address.rfind(':') + 1).c_str());
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (fd == -1 || bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1 || listen(fd, SOMAXCONN) == -1) {
+        cerr << "Error listening on port " << port << ": " << strerror(errno) << endl;
+        exit(1);
+    }
+    return fd;
+}
+
+// Function to connect every pair of ranks. Each rank connects to the lower
+// ranks and accepts the higher ones; the first message on a connection is the
+// rank of the connecting side. Returns one socket per rank (-1 for itself).
+vector<int> connectSummaPeers(const SummaGrid& grid, int listen_fd) {
+    int size = grid.rows * grid.cols;
+    vector<int> socks(size, -1);
+    int on = 1;
+    
+    for (int peer = 0; peer < grid.rank; peer++) {
+        const string& address = grid.peers[peer];
+        string host = address.substr(0, address.rfind(':'));
+        string port = address.substr(address.rfind(':') + 1);
+        addrinfo hints, *result;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0) {
+            cerr << "Error resolving peer address: " << address << endl;
+            exit(1);
+        }
+        
+        // The peer may not be listening yet
+        int fd = -1;
+        for (int attempt = 0; attempt < SUMMA_CONNECT_ATTEMPTS; attempt++) {
+            fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (connect(fd, result->ai_addr, result->ai_addrlen) == 0) break;
+            close(fd);
+            fd = -1;
+            usleep(100000);
+        }
+        freeaddrinfo(result);
+        if (fd == -1) {
+            cerr << "Error connecting to rank " << peer << " at " << address << endl;
+            exit(1);
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        int32_t my_rank = grid.rank;
+        if (!sendAll(fd, &my_rank, sizeof(my_rank))) {
+            exit(1);
+        }
+        socks[peer] = fd;
+    }
+    
+    for (int accepted = grid.rank + 1; accepted < size; accepted++) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd == -1) {
+            cerr << "Error accepting peer connection: " << strerror(errno) << endl;
+            exit(1);
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        int32_t peer;
+        if (!recvAll(fd, &peer, sizeof(peer))) {
+            exit(1);
+        }
+        if (peer <= grid.rank || peer >= size || socks[peer] != -1) {
+            cerr << "Error: Unexpected connection from rank " << peer << endl;
+            exit(1);
+        }
+        socks[peer] = fd;
+    }
+    return socks;
+}
+
+// Function to read rows [row_begin, row_end) and columns [col_begin, col_end)
+// of a matrix file. Rows before the block are skipped without being parsed,
+// and binary files are read at the offsets of the block only.
+vector<double> readMatrixBlock(const string& filename, int row_begin, int row_end, int col_begin, int col_end) {
+    MatrixStreamReader reader;
+    if (!reader.open(filename)) {
+        cerr << reader.error() << endl;
+        exit(1);
+    }
+    
+    int rows = row_end - row_begin;
+    vector<double> block;
+    block.reserve((size_t)rows * (col_end - col_begin));
+    if (reader.skipRows(row_begin) != row_begin || reader.readColumns(block, rows, col_begin, col_end) != rows) {
+        cerr << (reader.error().empty() ? "Error: Unexpected end of matrix data" : reader.error()) << endl;
+        exit(1);
+    }
+    return block;
+}
+
+// Child process function of a SUMMA rank: for every panel, add rows
+// [start_row, end_row) of A_panel * B_panel to the shared C block. The worker
+// waits on steps_ready for each panel and stays alive until the last one.
+void calculateSummaPortion(void* panelsA, void* panelsB, void* matrixC, SharedSummaData* summa, int start_row,
+                           int end_row, const KernelConfig& config) {
+    int P = summa->n_cols;
+    size_t a_slot = (size_t)summa->n_rows * summa->max_width;
+    size_t b_slot = (size_t)summa->max_width * P;
+    double* C = reinterpret_cast<double*>(static_cast<char*>(matrixC) + sizeof(SharedMatrixData));
+    
+    // The kernels overwrite their output, so each panel product goes to a
+    // private buffer and is then added to C
+    size_t partial_count = (size_t)max(0, end_row - start_row) * P;
+    vector<double> partial_buffer;
+    double* partial = workerScratch(partial_count, partial_buffer);
+    
+    for (int t = 0; t < summa->steps; t++) {
+        int ready = summa->steps_ready.load(memory_order_acquire);
+        while (ready <= t) {
+            futexWait(&summa->steps_ready, ready);
+            ready = summa->steps_ready.load(memory_order_acquire);
+        }
+        if (ready == SUMMA_ABORTED) break;
+        
+        int slot = t % 2;
+        int width = summa->widths[slot];
+        const double* A = static_cast<const double*>(panelsA) + slot * a_slot;
+        const double* B = static_cast<const double*>(panelsB) + slot * b_slot;
+        
+        traceEvent(PHASE_ROW_BLOCK, 'B', start_row, end_row);
+        multiplyRows(A + (size_t)start_row * width, B, partial, width, P, 0, end_row - start_row, config);
+        for (size_t i = 0; i < partial_count; i++) {
+            C[(size_t)start_row * P + i] += partial[i];
+        }
+        traceEvent(PHASE_ROW_BLOCK, 'E', start_row, end_row);
+        
+        if (summa->steps_done.fetch_add(1, memory_order_acq_rel) + 1 == (t + 1) * summa->n_workers) {
+            futexWake(&summa->steps_done);
+        }
+    }
+}
+
+// Function to run one rank of SUMMA. Rank (i, j) of the grid owns rows block i
+// and columns block j of C, the A block of the same rows and columns block j of
+// the inner dimension, and the B block of inner rows block i and columns block
+// j. The inner dimension is cut into panels at the boundaries of both
+// splits, so every panel has a single owner: at each step the owner of the A
+// panel sends it along its grid row and the owner of the B panel along its
+// grid column, and every rank adds A_panel * B_panel to its C block.
+// The shared segments and num_processes local workers are created once per
+// rank and reused for every panel; the C block accumulates in shared memory.
+// A communication thread fetches the next panel into the other of two shared
+// slots while the workers multiply the current one. Returns the local block of C.
+vector<double> multiplyMatricesSumma(const string& fileA, const string& fileB, int N, int M, int P,
+                                     const SummaGrid& grid, const vector<int>& socks, int num_processes,
+                                     const KernelConfig& config, SummaStats& stats) {
+    int my_row = grid.rank / grid.cols;
+    int my_col = grid.rank % grid.cols;
+    int row_begin, row_end, col_begin, col_end;
+    blockRange(N, grid.rows, my_row, row_begin, row_end);
+    blockRange(P, grid.cols, my_col, col_begin, col_end);
+    int local_rows = row_end - row_begin;
+    int local_cols = col_end - col_begin;
+    
+    // Inner blocks owned by this rank
+    int a_k_begin, a_k_end, b_k_begin, b_k_end;
+    blockRange(M, grid.cols, my_col, a_k_begin, a_k_end);
+    blockRange(M, grid.rows, my_row, b_k_begin, b_k_end);
+    
+    auto start_read = chrono::high_resolution_clock::now();
+    vector<double> A_block = readMatrixBlock(fileA, row_begin, row_end, a_k_begin, a_k_end);
+    vector<double> B_block = readMatrixBlock(fileB, b_k_begin, b_k_end, col_begin, col_end);
+    stats.read_seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start_read).count();
+    
+    // Panel boundaries: union of the A and B splits of the inner dimension
+    vector<int> cuts = {M};
+    for (int q = 0; q < grid.cols; q++) {
+        int begin, end;
+        blockRange(M, grid.cols, q, begin, end);
+        cuts.push_back(begin);
+    }
+    for (int p = 0; p < grid.rows; p++) {
+        int begin, end;
+        blockRange(M, grid.rows, p, begin, end);
+        cuts.push_back(begin);
+    }
+    sort(cuts.begin(), cuts.end());
+    cuts.erase(unique(cuts.begin(), cuts.end()), cuts.end());
+    int steps = cuts.size() - 1;
+    stats.steps = steps;
+    int max_width = 0;
+    for (int t = 0; t < steps; t++) {
+        max_width = max(max_width, cuts[t + 1] - cuts[t]);
+    }
+    
+    auto ownerOf = [&](int k, int parts) {
+        for (int q = 0; q < parts; q++) {
+            int begin, end;
+            blockRange(M, parts, q, begin, end);
+            if (k >= begin && k < end) return q;
+        }
+        return parts - 1;
+    };
+    
+    // Two panel slots of A and B, the C block and the control block, shared
+    // with the workers for the whole multiplication
+    traceEvent(PHASE_SHM_SETUP, 'B');
+    size_t A_size = 2 * (size_t)local_rows * max_width * sizeof(double);
+    size_t B_size = 2 * (size_t)max_width * local_cols * sizeof(double);
+    size_t C_size = sizeof(SharedMatrixData) + (size_t)local_rows * local_cols * sizeof(double);
+    double* shm_A = static_cast<double*>(createSharedSegment(shmName("A"), A_size));
+    double* shm_B = static_cast<double*>(createSharedSegment(shmName("B"), B_size));
+    void* shm_C = createEmptySharedMatrix(local_rows, local_cols, shmName("C"));
+    void* shm_summa = createSharedSegment(shmName("summa"), sizeof(SharedSummaData));
+    
+    int n_workers = max(1, min(num_processes, local_rows));
+    SharedSummaData* summa = new (shm_summa) SharedSummaData();
+    summa->steps_ready.store(0, memory_order_relaxed);
+    summa->steps_done.store(0, memory_order_relaxed);
+    summa->steps = steps;
+    summa->n_workers = n_workers;
+    summa->n_rows = local_rows;
+    summa->n_cols = local_cols;
+    summa->max_width = max_width;
+    traceEvent(PHASE_SHM_SETUP, 'E');
+    
+    auto cleanup = [&]() {
+        cleanupSharedMemory(shmName("A"), shm_A, A_size);
+        cleanupSharedMemory(shmName("B"), shm_B, B_size);
+        cleanupSharedMemory(shmName("C"), shm_C, C_size);
+        cleanupSharedMemory(shmName("summa"), shm_summa, sizeof(SharedSummaData));
+        cleanupSpawnResources();
+    };
+    
+    vector<WorkerTask> tasks;
+    for (int i = 0; i < n_workers; i++) {
+        int start, end;
+        blockRange(local_rows, n_workers, i, start, end);
+        tasks.push_back({WORKER_SUMMA, i, start, end});
+    }
+    vector<pid_t> child_pids;
+    if (!spawnWorkers(tasks, {shm_A, shm_B, shm_C, shm_summa}, config, child_pids)) {
+        cerr << "Error: Could not create worker processes" << endl;
+        summa->steps_ready.store(SUMMA_ABORTED);
+        futexWake(&summa->steps_ready);
+        waitWorkers(child_pids);
+        cleanup();
+        exit(1);
+    }
+    
+    struct PanelSlot {
+        double* A;          // local_rows x width
+        double* B;          // width x local_cols
+        int step = -1;
+        bool ready = false;
+    };
+    PanelSlot slots[2];
+    for (int s = 0; s < 2; s++) {
+        slots[s].A = shm_A + (size_t)s * local_rows * max_width;
+        slots[s].B = shm_B + (size_t)s * max_width * local_cols;
+    }
+    mutex slot_mutex;
+    condition_variable slot_changed;
+    bool aborted = false;   // set by either thread when the multiplication cannot finish
+    
+    // The comm thread does not exit on errors: it reports them, and the main
+    // thread stops the workers and removes the segments
+    thread comm_thread([&]() {
+        auto fail = [&]() {
+            {
+                lock_guard<mutex> lock(slot_mutex);
+                aborted = true;
+            }
+            slot_changed.notify_all();
+        };
+        
+        for (int t = 0; t < steps; t++) {
+            PanelSlot& slot = slots[t % 2];
+            {
+                unique_lock<mutex> lock(slot_mutex);
+                slot_changed.wait(lock, [&] { return !slot.ready || aborted; });
+                if (aborted) return;
+            }
+            
+            auto start_comm = chrono::high_resolution_clock::now();
+            int k0 = cuts[t], k1 = cuts[t + 1];
+            int width = k1 - k0;
+            size_t a_bytes = (size_t)local_rows * width * sizeof(double);
+            size_t b_bytes = (size_t)width * local_cols * sizeof(double);
+            
+            int a_owner = ownerOf(k0, grid.cols);
+            if (a_owner == my_col) {
+                int a_width = a_k_end - a_k_begin;
+                for (int i = 0; i < local_rows; i++) {
+                    copy(A_block.begin() + (size_t)i * a_width + (k0 - a_k_begin),
+                         A_block.begin() + (size_t)i * a_width + (k1 - a_k_begin), slot.A + (size_t)i * width);
+                }
+                for (int q = 0; q < grid.cols; q++) {
+                    if (q == my_col) continue;
+                    if (!sendAll(socks[my_row * grid.cols + q], slot.A, a_bytes)) {
+                        fail();
+                        return;
+                    }
+                    stats.bytes_sent += a_bytes;
+                }
+            } else {
+                if (!recvAll(socks[my_row * grid.cols + a_owner], slot.A, a_bytes)) {
+                    fail();
+                    return;
+                }
+                stats.bytes_received += a_bytes;
+            }
+            
+            int b_owner = ownerOf(k0, grid.rows);
+            if (b_owner == my_row) {
+                copy(B_block.begin() + (size_t)(k0 - b_k_begin) * local_cols,
+                     B_block.begin() + (size_t)(k1 - b_k_begin) * local_cols, slot.B);
+                for (int p = 0; p < grid.rows; p++) {
+                    if (p == my_row) continue;
+                    if (!sendAll(socks[p * grid.cols + my_col], slot.B, b_bytes)) {
+                        fail();
+                        return;
+                    }
+                    stats.bytes_sent += b_bytes;
+                }
+            } else {
+                if (!recvAll(socks[b_owner * grid.cols + my_col], slot.B, b_bytes)) {
+                    fail();
+                    return;
+                }
+                stats.bytes_received += b_bytes;
+            }
+            stats.comm_seconds += chrono::duration<double>(chrono::high_resolution_clock::now() - start_comm).count();
+            
+            {
+                lock_guard<mutex> lock(slot_mutex);
+                slot.step = t;
+                slot.ready = true;
+            }
+            slot_changed.notify_all();
+        }
+    });
+    
+    bool succeeded = true;
+    for (int t = 0; t < steps && succeeded; t++) {
+        PanelSlot& slot = slots[t % 2];
+        auto start_wait = chrono::high_resolution_clock::now();
+        {
+            unique_lock<mutex> lock(slot_mutex);
+            slot_changed.wait(lock, [&] { return (slot.ready && slot.step == t) || aborted; });
+            if (aborted) {
+                succeeded = false;
+                break;
+            }
+        }
+        auto start_compute = chrono::high_resolution_clock::now();
+        stats.wait_seconds += chrono::duration<double>(start_compute - start_wait).count();
+        
+        // Publish the panel, then release its slot once every worker is done with it
+        summa->widths[t % 2] = cuts[t + 1] - cuts[t];
+        summa->steps_ready.store(t + 1, memory_order_release);
+        futexWake(&summa->steps_ready);
+        succeeded = waitForCount(&summa->steps_done, (t + 1) * summa->n_workers, child_pids);
+        {
+            lock_guard<mutex> lock(slot_mutex);
+            slot.ready = false;
+        }
+        slot_changed.notify_all();
+        stats.compute_seconds += chrono::duration<double>(chrono::high_resolution_clock::now() - start_compute).count();
+    }
+    
+    if (!succeeded) {
+        // Shutting the connections down wakes the comm thread if it is blocked
+        // in send or recv, and makes the peers fail instead of waiting for us
+        {
+            lock_guard<mutex> lock(slot_mutex);
+            aborted = true;
+        }
+        slot_changed.notify_all();
+        for (int sock : socks) {
+            if (sock != -1) shutdown(sock, SHUT_RDWR);
+        }
+        summa->steps_ready.store(SUMMA_ABORTED);
+        futexWake(&summa->steps_ready);
+    }
+    bool workers_succeeded = waitWorkers(child_pids);
+    comm_thread.join();
+    if (!succeeded || !workers_succeeded) {
+        if (!workers_succeeded) {
+            cerr << "Error: A worker process failed" << endl;
+        }
+        cleanup();
+        exit(1);
+    }
+    
+    const double* C_data = reinterpret_cast<const double*>(static_cast<char*>(shm_C) + sizeof(SharedMatrixData));
+    vector<double> C_block(C_data, C_data + (size_t)local_rows * local_cols);
+    cleanup();
+    
+    return C_block;
+}
+
+// Number of 64-bit fields of SummaStats on the wire
+const int SUMMA_STATS_FIELDS = 8;
+
+// Function to send the statistics of a rank as big-endian 64-bit fields, so
+// that ranks built with a different struct layout or byte order agree
+bool sendSummaStats(int sock, const SummaStats& stats) {
+    double seconds[5] = {stats.read_seconds, stats.compute_seconds, stats.comm_seconds, stats.wait_seconds,
+                         stats.total_seconds};
+    uint64_t fields[SUMMA_STATS_FIELDS];
+    fields[0] = htobe64((uint64_t)stats.steps);
+    for (int i = 0; i < 5; i++) {
+        uint64_t bits;
+        memcpy(&bits, &seconds[i], sizeof(bits));
+        fields[1 + i] = htobe64(bits);
+    }
+    fields[6] = htobe64((uint64_t)stats.bytes_sent);
+    fields[7] = htobe64((uint64_t)stats.bytes_received);
+    return sendAll(sock, fields, sizeof(fields));
+}
+
+// Function to receive the statistics sent by sendSummaStats
+bool recvSummaStats(int sock, SummaStats& stats) {
+    uint64_t fields[SUMMA_STATS_FIELDS];
+    if (!recvAll(sock, fields, sizeof(fields))) {
+        return false;
+    }
+    double seconds[5];
+    for (int i = 0; i < 5; i++) {
+        uint64_t bits = be64toh(fields[1 + i]);
+        memcpy(&seconds[i], &bits, sizeof(bits));
+    }
+    stats.steps = (int)be64toh(fields[0]);
+    stats.read_seconds = seconds[0];
+    stats.compute_seconds = seconds[1];
+    stats.comm_seconds = seconds[2];
+    stats.wait_seconds = seconds[3];
+    stats.total_seconds = seconds[4];
+    stats.bytes_sent = (long)be64toh(fields[6]);
+    stats.bytes_received = (long)be64toh(fields[7]);
+    return true;
+}
+
+// Function to run one SUMMA rank end to end: connect to the other ranks,
+// multiply, and gather the result and the statistics on rank 0, which writes
+// the output files
+int runSummaRank(const string& fileA, const string& fileB, const SummaGrid& grid, int listen_fd, int num_processes,
+                 const KernelConfig& config) {
+    auto start_total = chrono::high_resolution_clock::now();
+    int size = grid.rows * grid.cols;
+    
+    long rows_A, cols_A, rows_B, cols_B;
+    string error;
+    if (!peekMatrixShape(fileA, rows_A, cols_A, error) || !peekMatrixShape(fileB, rows_B, cols_B, error)) {
+        cerr << error << endl;
+        return 1;
+    }
+    if (cols_A != rows_B) {
+        cerr << "Error: Incompatible matrix dimensions for multiplication" << endl;
+        cerr << "Matrix A: " << rows_A << "x" << cols_A << endl;
+        cerr << "Matrix B: " << rows_B << "x" << cols_B << endl;
+        return 1;
+    }
+    int N = rows_A, M = cols_A, P = cols_B;
+    if (grid.rows > N || grid.cols > P) {
+        cerr << "Error: The process grid is larger than the result matrix (" << N << "x" << P << ")" << endl;
+        return 1;
+    }
+    
+    if (listen_fd == -1) {
+        listen_fd = listenSummaPort(grid.peers[grid.rank]);
+    }
+    vector<int> socks = connectSummaPeers(grid, listen_fd);
+    close(listen_fd);
+    g_summa_sockets = socks;
+    
+    SummaStats stats;
+    vector<double> C_block = multiplyMatricesSumma(fileA, fileB, N, M, P, grid, socks, num_processes, config, stats);
+    stats.total_seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start_total).count();
+    
+    if (grid.rank != 0) {
+        if (!sendSummaStats(socks[0], stats) || !sendAll(socks[0], C_block.data(), C_block.size() * sizeof(double))) {
+            return 1;
+        }
+        for (int fd : socks) {
+            if (fd != -1) close(fd);
+        }
+        return 0;
+    }
+    
+    vector<SummaStats> all_stats(size);
+    all_stats[0] = stats;
+    for (int r = 1; r < size; r++) {
+        if (!recvSummaStats(socks[r], all_stats[r])) {
+            return 1;
+        }
+    }
+    
+    // Gather C one grid row at a time and write it out
+    string output_folder = "output_" + to_string(num_processes);
+    string grid_name = to_string(grid.rows) + "x" + to_string(grid.cols);
+    string result_file = output_folder + "/C_summa_" + grid_name + ".txt";
+    string log_file = output_folder + "/C_summa_" + grid_name + ".log.txt";
+    if (!fs::exists(output_folder)) {
+        fs::create_directory(output_folder);
+    }
+    
+    ofstream file(result_file);
+    if (!file.is_open()) {
+        cerr << "Error opening file for writing: " << result_file << endl;
+        return 1;
+    }
+    file << fixed << setprecision(numeric_limits<double>::max_digits10);
+    for (int p = 0; p < grid.rows; p++) {
+        int row_begin, row_end;
+        blockRange(N, grid.rows, p, row_begin, row_end);
+        int block_rows = row_end - row_begin;
+        vector<double> C_rows((size_t)block_rows * P);
+        for (int q = 0; q < grid.cols; q++) {
+            int col_begin, col_end;
+            blockRange(P, grid.cols, q, col_begin, col_end);
+            int block_cols = col_end - col_begin;
+            vector<double> block;
+            if (p == 0 && q == 0) {
+                block.swap(C_block);
+            } else {
+                block.resize((size_t)block_rows * block_cols);
+                if (!recvAll(socks[p * grid.cols + q], block.data(), block.size() * sizeof(double))) {
+                    return 1;
+                }
+            }
+            for (int i = 0; i < block_rows; i++) {
+                copy(block.begin() + (size_t)i * block_cols, block.begin() + (size_t)(i + 1) * block_cols,
+                     C_rows.begin() + (size_t)i * P + col_begin);
+            }
+        }
+        for (int i = 0; i < block_rows; i++) {
+            for (int j = 0; j < P; j++) {
+                file << C_rows[(size_t)i * P + j];
+                if (j < P - 1) file << " ";
+            }
+            file << endl;
+        }
+    }
+    file.close();
+    for (int fd : socks) {
+        if (fd != -1) close(fd);
+    }
+    double total_time = chrono::duration<double>(chrono::high_resolution_clock::now() - start_total).count();
+    
+    ofstream log_stream(log_file);
+    if (!log_stream.is_open()) {
+        cerr << "Error: Could not open log file." << endl;
+        return 1;
+    }
+    log_stream << fixed << setprecision(6);
+    cout << fixed << setprecision(6);
+    
+    string summary = "SUMMA " + grid_name + " grid, " + to_string(all_stats[0].steps) + " panels, " +
+                     to_string(num_processes) + " processes per rank, kernel " + describeKernel(config);
+    log_stream << summary << endl;
+    cout << summary << endl;
+    log_stream << "Total time: " << total_time << " seconds" << endl;
+    cout << "Total time: " << total_time << " seconds" << endl;
+    
+    for (int r = 0; r < size; r++) {
+        const SummaStats& s = all_stats[r];
+        stringstream line;
+        line << fixed << setprecision(6);
+        line << "Rank " << r << " (" << r / grid.cols << "," << r % grid.cols << "): read " << s.read_seconds
+             << " s, compute " << s.compute_seconds << " s, communication " << s.comm_seconds << " s (waited "
+             << s.wait_seconds << " s), sent " << s.bytes_sent / 1048576.0 << " MiB, received "
+             << s.bytes_received / 1048576.0 << " MiB, total " << s.total_seconds << " s";
+        log_stream << line.str() << endl;
+        cout << line.str() << endl;
+    }
+    
+    log_stream << "Result written to: " << result_file << endl;
+    cout << "Result written to: " << result_file << endl;
+    log_stream.close();
+    return 0;
+}
+
+// Function to run every rank of a SUMMA grid on this host. The listening
+// sockets are bound to free ports before forking, so the ranks can connect
+// right away.
+int launchSummaLocal(const string& fileA, const string& fileB, SummaGrid grid, int num_processes,
+                     const KernelConfig& config) {
+    int size = grid.rows * grid.cols;
+    vector<int> listen_fds;
+    grid.peers.clear();
+    for (int r = 0; r < size; r++) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        socklen_t len = sizeof(addr);
+        if (fd == -1 || bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1 ||
+            listen(fd, SOMAXCONN) == -1 || getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) == -1) {
+            cerr << "Error creating rank socket: " << strerror(errno) << endl;
+            return 1;
+        }
+        listen_fds.push_back(fd);
+        grid.peers.push_back("127.0.0.1:" + to_string(ntohs(addr.sin_port)));
+    }
+    
+    cout.flush();
+    vector<pid_t> ranks;
+    for (int r = 0; r < size; r++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            cerr << "Error: Could not create rank processes" << endl;
+            return 1;
+        }
+        if (pid == 0) {
+            // Child process: one rank with its own shared memory names
+            for (int other = 0; other < size; other++) {
+                if (other != r) close(listen_fds[other]);
+            }
+            g_shm_prefix = "/matrix_" + to_string(getpid()) + "_";
+            g_cleanup_pid = getpid();
+            grid.rank = r;
+            int status = runSummaRank(fileA, fileB, grid, listen_fds[r], num_processes, config);
+            cout.flush();
+            _exit(status);
+        }
+        ranks.push_back(pid);
+    }
+    for (int fd : listen_fds) {
+        close(fd);
+    }
+    
+    bool succeeded = true;
+    for (pid_t pid : ranks) {
+        int status;
+        if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            // A rank killed by a signal could not remove its segments
+            cleanupSegmentsOf(pid);
+            succeeded = false;
+        }
+    }
+    if (!succeeded) {
+        cerr << "Error: A rank process failed" << endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Function to remove the shared memory segments of a process that died
+// without removing them (their names start with its shared memory prefix)
+void cleanupSegmentsOf(pid_t pid) {
+    string prefix = "matrix_" + to_string(pid) + "_";
+    error_code ec;
+    for (const auto& entry : fs::directory_iterator("/dev/shm", ec)) {
+        string name = entry.path().filename().string();
+        if (name.compare(0, prefix.size(), prefix) == 0) {
+            shm_unlink(("/" + name).c_str());
+        }
+    }
+}
+
+// Function to make a futex system call. Waits routinely fail with EAGAIN or
+// ETIMEDOUT, and syscall() would store that in errno, which clone workers
+// share with the parent; the call is issued directly where the architecture
+// is known, and the result is returned as -errno instead.
+long rawFutex(atomic<int>* addr, int op, int value, const timespec* timeout) {
+#if defined(__x86_64__)
+    long result;
+    register long r10 asm("r10") = reinterpret_cast<long>(timeout);
+    asm volatile("syscall"
+                 : "=a"(result)
+                 : "0"((long)SYS_futex), "D"(addr), "S"((long)op), "d"((long)value), "r"(r10)
+                 : "rcx", "r11", "memory");
+    return result;
+#elif defined(__aarch64__)
+    register long x8 asm("x8") = SYS_futex;
+    register long x0 asm("x0") = reinterpret_cast<long>(addr);
+    register long x1 asm("x1") = op;
+    register long x2 asm("x2") = value;
+    register long x3 asm("x3") = reinterpret_cast<long>(timeout);
+    asm volatile("svc 0" : "+r"(x0) : "r"(x8), "r"(x1), "r"(x2), "r"(x3) : "memory");
+    return x0;
+#else
+    int saved_errno = errno;
+    long result = syscall(SYS_futex, reinterpret_cast<int*>(addr), op, value, timeout, nullptr, 0);
+    if (result < 0) {
+        result = -errno;
+    }
+    errno = saved_errno;
+    return result;
+#endif
+}
+
+// Function to sleep until *addr no longer holds expected (shared-memory futex),
+// or until the timeout if one is given
+void futexWait(atomic<int>* addr, int expected, const timespec* timeout) {
+    rawFutex(addr, FUTEX_WAIT, expected, timeout);
+}
+
+// Function to wake every process waiting on addr
+void futexWake(atomic<int>* addr) {
+    rawFutex(addr, FUTEX_WAKE, INT_MAX, nullptr);
+}
+
+// Function to wait until a counter shared with the workers reaches target. A
+// worker that died would never count itself, so the wait wakes up every
+// 100 ms to check the workers. Returns false if one of them failed.
+bool waitForCount(atomic<int>* counter, int target, const vector<pid_t>& child_pids) {
+    timespec timeout = {0, 100000000};
+    int count = counter->load(memory_order_acquire);
+    while (count < target) {
+        futexWait(counter, count, &timeout);
+        count = counter->load(memory_order_acquire);
+        
+        // A clean exit comes after the worker's last count; WNOWAIT leaves the
+        // workers to waitWorkers
+        for (pid_t pid : child_pids) {
+            siginfo_t info;
+            info.si_pid = 0;
+            if (count < target && waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid != 0 &&
+                (info.si_code != CLD_EXITED || info.si_status != 0)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Function to release every pipelined worker after a failure. The flag is set
+// first, then the futex word itself is changed: a worker that has just seen
+// rows_ready below its panel and is about to call FUTEX_WAIT then finds a
+// different value and returns instead of sleeping forever.
+void abortPipeline(SharedPipelineData* pipeline) {
+    pipeline->failed.store(1);
+    pipeline->rows_ready.store(PIPELINE_ABORTED);
+    futexWake(&pipeline->rows_ready);
+}
+
+// Child process function for pipelined mode: claim panels of rows in order and
+// compute each one as soon as its rows of A have been parsed
+void calculatePipelinedPortion(void* matrixA, void* matrixB, void* matrixC, SharedPipelineData* pipeline,
+                               const KernelConfig& config) {
+    int N, M, P;
+    operandShapes(matrixA, matrixB, config, N, M, P);
+    N = pipeline->n_rows;
+    
+    const double* A = reinterpret_cast<const double*>(static_cast<char*>(matrixA) + sizeof(SharedMatrixData));
+    const double* B = reinterpret_cast<const double*>(static_cast<char*>(matrixB) + sizeof(SharedMatrixData));
+    double* C = reinterpret_cast<double*>(static_cast<char*>(matrixC) + sizeof(SharedMatrixData));
+    
+    for (;;) {
+        int panel = pipeline->next_panel.fetch_add(1, memory_order_relaxed);
+        int start_row = panel * pipeline->panel_rows;
+        if (start_row >= N) break;
+        int end_row = min(start_row + pipeline->panel_rows, N);
+        
+        int ready = pipeline->rows_ready.load(memory_order_acquire);
+        if (ready < end_row) {
+            traceEvent(PHASE_PANEL_WAIT, 'B', start_row, end_row);
+            while (ready < end_row) {
+                futexWait(&pipeline->rows_ready, ready);
+                ready = pipeline->rows_ready.load(memory_order_acquire);
+            }
+            traceEvent(PHASE_PANEL_WAIT, 'E', start_row, end_row);
+        }
+        if (pipeline->failed.load(memory_order_acquire)) break;
+        
+        traceEvent(PHASE_ROW_BLOCK, 'B', start_row, end_row);
+        multiplyRows(A, B, C, M, P, start_row, end_row, config);
+        traceEvent(PHASE_ROW_BLOCK, 'E', start_row, end_row);
+    }
+}
+
+// Function to multiply A x B while A is still being parsed. B must already be
+// loaded and the shape of A known (see peekMatrixShape). Workers are forked
+// before A is read; the parent then parses A panel by panel straight into
+// shared memory, so computing a panel overlaps with parsing the next ones.
+// With keep_A the parsed A is also returned in A for later use (baseline,
+// verification); otherwise A is left empty.
+vector<vector<double>> multiplyMatricesPipelined(const string& fileA, int N, int M, const vector<vector<double>>& B,
+                                                 int num_processes, const KernelConfig& config,
+                                                 bool keep_A, vector<vector<double>>& A, PipelineStats& stats) {
+    int P = config.trans_b ? B.size() : B[0].size();
+    
+    if (num_processes > N) {
+        cout << "Warning: Number of processes reduced to number of rows in the result matrix (" << N << ")" << endl;
+        num_processes = N;
+    }
+    
+    traceEvent(PHASE_SHM_SETUP, 'B');
+    
+    // A is filled in as it is parsed; only its metadata is known up front
+    void* shm_B = createSharedMatrix(B, shmName("B"));
+    void* shm_A = createEmptySharedMatrix(N, M, shmName("A"));
+    void* shm_C = createEmptySharedMatrix(N, P, shmName("C"));
+    void* shm_pipe = createSharedSegment(shmName("pipeline"), sizeof(SharedPipelineData));
+    size_t A_size = sizeof(SharedMatrixData) + (size_t)N * M * sizeof(double);
+    size_t B_size = sizeof(SharedMatrixData) + (size_t)M * P * sizeof(double);
+    size_t C_size = sizeof(SharedMatrixData) + (size_t)N * P * sizeof(double);
+    double* A_data = reinterpret_cast<double*>(static_cast<char*>(shm_A) + sizeof(SharedMatrixData));
+    
+    SharedPipelineData* pipeline = new (shm_pipe) SharedPipelineData();
+    pipeline->rows_ready.store(0, memory_order_relaxed);
+    pipeline->next_panel.store(0, memory_order_relaxed);
+    pipeline->failed.store(0, memory_order_relaxed);
+    pipeline->panel_rows = max(1, N / (num_processes * PIPELINE_PANELS_PER_WORKER));
+    pipeline->n_rows = N;
+    stats.panel_rows = pipeline->panel_rows;
+    stats.panels = (N + pipeline->panel_rows - 1) / pipeline->panel_rows;
+    
+    traceEvent(PHASE_SHM_SETUP, 'E');
+    
+    auto cleanup = [&]() {
+        cleanupSharedMemory(shmName("A"), shm_A, A_size);
+        cleanupSharedMemory(shmName("B"), shm_B, B_size);
+        cleanupSharedMemory(shmName("C"), shm_C, C_size);
+        cleanupSharedMemory(shmName("pipeline"), shm_pipe, sizeof(SharedPipelineData));
+    };
+    
+    vector<WorkerTask> tasks;
+    for (int i = 0; i < num_processes; i++) {
+        tasks.push_back({WORKER_PIPELINE, i, 0, N});
+    }
+    vector<pid_t> child_pids;
+    if (!spawnWorkers(tasks, {shm_A, shm_B, shm_C, shm_pipe}, config, child_pids)) {
+        cerr << "Error: Could not create worker processes" << endl;
+        abortPipeline(pipeline);
+        waitWorkers(child_pids);
+        cleanup();
+        exit(1);
+    }
+    
+    // Parse A one panel at a time, publishing each panel to the workers
+    auto start_parse = chrono::high_resolution_clock::now();
+    traceEvent(PHASE_READ_A, 'B');
+    MatrixStreamReader reader;
+    bool ok = reader.open(fileA);
+    vector<double> panel;
+    A.clear();
+    if (keep_A) A.reserve(N);
+    int rows_ready = 0;
+    while (ok && rows_ready < N) {
+        panel.clear();
+        long got = reader.readRows(panel, pipeline->panel_rows);
+        if (got <= 0 || reader.cols() != M || rows_ready + got > N) {
+            ok = false;
+            break;
+        }
+        copy(panel.begin(), panel.end(), A_data + (long)rows_ready * M);
+        for (long r = 0; keep_A && r < got; r++) {
+            A.emplace_back(panel.begin() + r * M, panel.begin() + (r + 1) * M);
+        }
+        rows_ready += got;
+        pipeline->rows_ready.store(rows_ready, memory_order_release);
+        futexWake(&pipeline->rows_ready);
+    }
+    traceEvent(PHASE_READ_A, 'E');
+    auto end_parse = chrono::high_resolution_clock::now();
+    stats.parse_seconds = chrono::duration<double>(end_parse - start_parse).count();
+    
+    if (!ok) {
+        // Release the workers before reporting the error
+        abortPipeline(pipeline);
+    }
+    
+    bool succeeded = waitWorkers(child_pids);
+    
+    if (!ok || !succeeded) {
+        if (!ok) {
+            cerr << (reader.error().empty() ? "Error: Matrix A changed while it was being read: " + fileA : reader.error())
+                 << endl;
+        } else {
+            cerr << "Error: A worker process failed" << endl;
+        }
+        cleanup();
+        exit(1);
+    }
+    
+    traceEvent(PHASE_EXTRACT, 'B');
+    vector<vector<double>> C = extractMatrix(shm_C);
+    traceEvent(PHASE_EXTRACT, 'E');
+    
+    cleanup();
+    return C;
+}
+
+// Function to find the rows that differ between two matrices of the same shape.
+// Blocks of DELTA_BLOCK_ROWS rows are hashed first, and only the rows of the
+// blocks whose hashes differ are hashed individually.
+vector<int> findChangedRows(const vector<vector<double>>& previous, const vector<vector<double>>& current) {
+    int rows = current.size();
+    size_t row_bytes = current[0].size() * sizeof(double);
+    vector<int> changed;
+    
+    for (int block_start = 0; block_start < rows; block_start += DELTA_BLOCK_ROWS) {
+        int block_end = min(block_start + DELTA_BLOCK_ROWS, rows);
+        XXH64 hash_prev, hash_cur;
+        for (int i = block_start; i < block_end; i++) {
+            hash_prev.update(previous[i].data(), row_bytes);
+            hash_cur.update(current[i].data(), row_bytes);
+        }
+        if (hash_prev.digest() == hash_cur.digest()) continue;
+        
+        for (int i = block_start; i < block_end; i++) {
+            if (xxh64(previous[i].data(), row_bytes) != xxh64(current[i].data(), row_bytes)) {
+                changed.push_back(i);
+            }
+        }
+    }
+    return changed;
+}
+
+// Child process function to produce the C rows of tasks [start_task, end_task)
+// in delta mode. matrixC holds the previous C on entry.
+void calculateDeltaPortion(void* matrixA, void* matrixB, void* matrixC, void* delta, int start_task, int end_task,
+                           const KernelConfig& config) {
+    SharedMatrixData* metadataA = static_cast<SharedMatrixData*>(matrixA);
+    SharedMatrixData* metadataB = static_cast<SharedMatrixData*>(matrixB);
+    SharedDeltaData* metadataD = static_cast<SharedDeltaData*>(delta);
+    
+    int M = metadataA->n_cols;
+    int P = metadataB->n_cols;
+    int n_dB = metadataD->n_dB_rows;
+    
+    const double* A = reinterpret_cast<const double*>(static_cast<char*>(matrixA) + sizeof(SharedMatrixData));
+    const double* B = reinterpret_cast<const double*>(static_cast<char*>(matrixB) + sizeof(SharedMatrixData));
+    double* C = reinterpret_cast<double*>(static_cast<char*>(matrixC) + sizeof(SharedMatrixData));
+    const DeltaTask* tasks = reinterpret_cast<const DeltaTask*>(metadataD + 1);
+    const int* dB_rows = reinterpret_cast<const int*>(tasks + metadataD->n_tasks);
+    const double* dB = reinterpret_cast<const double*>(dB_rows + n_dB);
+    
+    int task = start_task;
+    while (task < end_task) {
+        int row = tasks[task].row;
+        if (tasks[task].recompute) {
+            // Group consecutive recomputed rows into a single kernel call
+            int end = task + 1;
+            while (end < end_task && tasks[end].recompute && tasks[end].row == tasks[end - 1].row + 1) end++;
+            int end_row = tasks[end - 1].row + 1;
+            traceEvent(PHASE_ROW_BLOCK, 'B', row, end_row);
+            multiplyRows(A, B, C, M, P, row, end_row, config);
+            traceEvent(PHASE_ROW_BLOCK, 'E', row, end_row);
+            task = end;
+            continue;
+        }
+        
+        // Rank-k update: C[i][:] += sum over changed k of A[i][k] * (B_new - B_old)[k][:]
+        double* c_row = C + (long)row * P;
+        for (int d = 0; d < n_dB; d++) {
+            double a = A[(long)row * M + dB_rows[d]];
+            if (a == 0.0) continue;
+            const double* d_row = dB + (long)d * P;
+            for (int j = 0; j < P; j++) {
+                c_row[j] += a * d_row[j];
+            }
+        }
+        task++;
+    }
+}
+
+// Function to multiply A x B given the inputs and result of a previous run.
+// Rows of C whose row of A changed are recomputed; if rows of B changed, the
+// other rows are updated in place with a rank-k correction. The cost is
+// proportional to the size of the change rather than N * M * P. When the
+// change is too large to pay off, the full parallel multiply is used.
+vector<vector<double>> multiplyMatricesDelta(const vector<vector<double>>& A, const vector<vector<double>>& B,
+                                             const vector<vector<double>>& prev_A, const vector<vector<double>>& prev_B,
+                                             const vector<vector<double>>& prev_C, int num_processes,
+                                             const KernelConfig& config, DeltaStats& stats) {
+    int N = A.size();
+    int M = A[0].size();
+    int P = B[0].size();
+    
+    traceEvent(PHASE_DELTA, 'B');
+    vector<int> changed_A = findChangedRows(prev_A, A);
+    vector<int> changed_B = findChangedRows(prev_B, B);
+    traceEvent(PHASE_DELTA, 'E');
+    stats.changed_rows_A = changed_A.size();
+    stats.changed_rows_B = changed_B.size();
+    
+    // Build the task list and estimate its cost in multiply-adds
+    vector<char> recompute(N, 0);
+    for (int row : changed_A) {
+        recompute[row] = 1;
+    }
+    vector<DeltaTask> tasks;
+    for (int i = 0; i < N; i++) {
+        if (recompute[i] || !changed_B.empty()) {
+            tasks.push_back({i, recompute[i]});
+        }
+    }
+    double cost = (double)changed_A.size() * M * P + (double)(N - changed_A.size()) * changed_B.size() * P;
+    if (cost >= (double)N * M * P) {
+        stats.incremental = false;
+        stats.reason = "change too large";
+        return multiplyMatricesParallel(A, B, num_processes, config);
+    }
+    stats.incremental = true;
+    
+    // Previous C is the starting point; unchanged rows need no work at all
+    void* shm_A = createSharedMatrix(A, shmName("A"));
+    void* shm_B = createSharedMatrix(B, shmName("B"));
+    void* shm_C = createSharedMatrix(prev_C, shmName("C"));
+    size_t A_size = sizeof(SharedMatrixData) + (size_t)N * M * sizeof(double);
+    size_t B_size = sizeof(SharedMatrixData) + (size_t)M * P * sizeof(double);
+    size_t C_size = sizeof(SharedMatrixData) + (size_t)N * P * sizeof(double);
+    
+    int n_dB = changed_B.size();
+    size_t D_size = sizeof(SharedDeltaData) + tasks.size() * sizeof(DeltaTask) + n_dB * sizeof(int) +
+                    (size_t)n_dB * P * sizeof(double);
+    void* shm_D = createSharedSegment(shmName("delta"), D_size);
+    
+    SharedDeltaData* D_metadata = static_cast<SharedDeltaData*>(shm_D);
+    D_metadata->n_tasks = tasks.size();
+    D_metadata->n_dB_rows = n_dB;
+    D_metadata->n_cols = P;
+    DeltaTask* D_tasks = reinterpret_cast<DeltaTask*>(D_metadata + 1);
+    int* D_rows = reinterpret_cast<int*>(D_tasks + tasks.size());
+    double* D_values = reinterpret_cast<double*>(D_rows + n_dB);
+    copy(tasks.begin(), tasks.end(), D_tasks);
+    for (int d = 0; d < n_dB; d++) {
+        int k = changed_B[d];
+        D_rows[d] = k;
+        for (int j = 0; j < P; j++) {
+            D_values[(long)d * P + j] = B[k][j] - prev_B[k][j];
+        }
+    }
+    
+    // Split the tasks into contiguous ranges of roughly equal cost
+    int n_tasks = tasks.size();
+    num_processes = max(1, min(num_processes, n_tasks));
+    vector<int> bounds(num_processes + 1, n_tasks);
+    bounds[0] = 0;
+    double done = 0.0;
+    int worker = 1;
+    for (int t = 0; t < n_tasks && worker < num_processes; t++) {
+        done += tasks[t].recompute ? (double)M * P : (double)n_dB * P;
+        // A range ends after at least one task, when it reaches its share of the
+        // cost or when the remaining tasks are just enough for one per range
+        bool share_reached = done >= cost * worker / num_processes;
+        bool tasks_needed = n_tasks - (t + 1) == num_processes - worker;
+        if (share_reached || tasks_needed) {
+            bounds[worker++] = t + 1;
+        }
+    }
+    
+    // No range is empty, so workers are numbered densely
+    vector<WorkerTask> worker_tasks;
+    for (int i = 0; i < num_processes; i++) {
+        worker_tasks.push_back({WORKER_DELTA, i, bounds[i], bounds[i + 1]});
+    }
+    
+    auto cleanup = [&]() {
+        cleanupSharedMemory(shmName("A"), shm_A, A_size);
+        cleanupSharedMemory(shmName("B"), shm_B, B_size);
+        cleanupSharedMemory(shmName("C"), shm_C, C_size);
+        cleanupSharedMemory(shmName("delta"), shm_D, D_size);
+    };
+    
+    vector<pid_t> child_pids;
+    bool spawned = spawnWorkers(worker_tasks, {shm_A, shm_B, shm_C, shm_D}, config, child_pids);
+    bool succeeded = waitWorkers(child_pids);
+    if (!spawned || !succeeded) {
+        cerr << "Error: " << (spawned ? "A worker process failed" : "Could not create worker processes") << endl;
+        cleanup();
+        exit(1);
+    }
+    
+    traceEvent(PHASE_EXTRACT, 'B');
+    vector<vector<double>> C = extractMatrix(shm_C);
+    traceEvent(PHASE_EXTRACT, 'E');
+    
+    cleanup();
+    return C;
+}
+
+// Function to parse a size given to --mem-limit: a number of MiB, or a number
+// followed by K, M or G
+bool parseMemorySize(const string& spec, double& bytes) {
+    char* end;
+    double value = strtod(spec.c_str(), &end);
+    if (end == spec.c_str() || !(value > 0)) return false;
+    
+    string unit = end;
+    double scale;
+    if (unit.empty() || unit == "M" || unit == "m") {
+        scale = 1 << 20;
+    } else if (unit == "K" || unit == "k") {
+        scale = 1 << 10;
+    } else if (unit == "G" || unit == "g") {
+        scale = 1 << 30;
+    } else {
+        return false;
+    }
+    bytes = value * scale;
+    return true;
+}
+
+// Function to read a field of /proc/self/status given in kB (VmRSS, VmHWM, ...).
+// Returns -1 if the field is missing.
+long procStatusKB(const string& field) {
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line)) {
+        if (line.compare(0, field.size() + 1, field + ":") == 0) {
+            return atol(line.c_str() + field.size() + 1);
+        }
+    }
+    return -1;
+}
+
+// Function to estimate the heap used by a nested-vector matrix
+double nestedMatrixBytes(long rows, long cols) {
+    return (double)rows * (cols * sizeof(double) + NESTED_ROW_OVERHEAD);
+}
+
+// Function to get the size of the shared memory segment of a matrix, in whole pages
+double sharedMatrixBytes(long rows, long cols) {
+    long page = sysconf(_SC_PAGESIZE);
+    long bytes = sizeof(SharedMatrixData) + rows * cols * (long)sizeof(double);
+    return (double)((bytes + page - 1) / page * page);
+}
+
+// Function to estimate the peak memory of a run with the choices already made
+// in plan. The parent writes or reads every page of the shared segments, so
+// they count towards its resident size along with its nested copies of A, B,
+// C_seq and C_par; workers only add what they allocate themselves.
+void estimateMemory(const MemoryRequest& request, MemoryPlan& plan) {
+    const KernelConfig& config = request.config;
+    long N = config.trans_a ? request.cols_A : request.rows_A;
+    long M = config.trans_a ? request.rows_A : request.cols_A;
+    long P = config.trans_b ? request.rows_B : request.cols_B;
+    
+    double A = nestedMatrixBytes(request.rows_A, request.cols_A);
+    double B = nestedMatrixBytes(request.rows_B, request.cols_B);
+    double C = nestedMatrixBytes(N, P);
+    double shared = sharedMatrixBytes(request.rows_A, request.cols_A) +
+                    sharedMatrixBytes(request.rows_B, request.cols_B) + sharedMatrixBytes(N, P);
+    double C_seq = request.baseline && !plan.drop_baseline ? C : 0.0;
+    double C_seq_during = plan.baseline_after ? 0.0 : C_seq;
+    
+    FastPathShape shape = fastPathShape(N, M, P);
+    double fast_path_bytes = ((double)N * M + (double)M * P + (double)N * P) * sizeof(double);
+    bool inline_run = shape != SHAPE_GENERAL && (plan.inline_fast_path || fast_path_bytes < FAST_PATH_INLINE_BYTES ||
+                                                 request.num_processes == 1);
+    
+    // Live data of the parent while the workers run and once they are done
+    double during, after;
+    if (request.pipeline) {
+        // A is parsed straight into shared memory; the nested copy is kept only if it is used later
+        double kept_A = C_seq > 0.0 || request.verify ? A : 0.0;
+        during = B + shared + kept_A + C;
+        after = kept_A + B + C + C_seq;
+        plan.workers = request.num_processes;
+    } else if (inline_run) {
+        during = A + B + C_seq_during + C + (double)(N + M + P) * sizeof(double);
+        after = A + B + C + C_seq;
+        plan.workers = 0;
+    } else {
+        // --delta also holds the previous A, B and C
+        during = A + B + C_seq_during + shared + C + (request.delta ? A + B + C : 0.0);
+        after = A + B + C + C_seq;
+        plan.workers = min<long>(request.num_processes, shape == SHAPE_VECMAT ? P : N);
+    }
+    
+    // Workers started with exec load their own copy of the program. Workers
+    // of A^T pack one block of rows (in their stack slot for clone workers).
+    plan.worker_bytes = g_spawn_strategy == SPAWN_VFORK ? plan.base_bytes : 0.0;
+    if (shape == SHAPE_GENERAL && config.trans_a && plan.workers > 0) {
+        long block_rows = max(1L, TRACE_MIN_BLOCK_WORK / max(1L, M * P));
+        block_rows = min(block_rows, (N + plan.workers - 1) / plan.workers);
+        plan.worker_bytes += (double)block_rows * M * sizeof(double);
+    }
+    
+    // Clone workers run on stacks allocated by the parent
+    double stacks = g_spawn_strategy == SPAWN_CLONE ? (double)plan.workers * CLONE_STACK_SIZE : 0.0;
+    plan.parent_bytes = plan.base_bytes + max(during, after) + stacks;
+    plan.total_bytes = plan.parent_bytes + plan.workers * plan.worker_bytes;
+}
+
+// Function to plan a run under a memory limit (no limit if limit_bytes is 0).
+// Over the limit, the cheapest changes are tried first: running the baseline
+// after the parallel multiplication so that C_seq and the shared segments are
+// never live together, computing a degenerate shape inline without shared
+// copies, and finally skipping the baseline. Each change is kept only if it
+// lowers the estimate; the caller checks whether the result fits.
+MemoryPlan planMemory(const MemoryRequest& request, double base_bytes, double limit_bytes) {
+    MemoryPlan plan;
+    plan.base_bytes = base_bytes;
+    plan.limit_bytes = limit_bytes;
+    plan.baseline_after = request.pipeline;
+    estimateMemory(request, plan);
+    
+    auto attempt = [&](void (*change)(MemoryPlan&), const string& decision) {
+        if (limit_bytes <= 0 || plan.total_bytes <= limit_bytes) return;
+        MemoryPlan trial = plan;
+        change(trial);
+        estimateMemory(request, trial);
+        if (trial.total_bytes < plan.total_bytes) {
+            trial.decisions.push_back(decision);
+            plan = trial;
+        }
+    };
+    attempt([](MemoryPlan& p) { p.baseline_after = true; }, "baseline moved after the parallel run");
+    attempt([](MemoryPlan& p) { p.inline_fast_path = true; }, "fast path computed inline");
+    attempt([](MemoryPlan& p) { p.drop_baseline = true; }, "baseline skipped");
+    return plan;
+}
+
+// Function to describe a memory plan for the log
+string describeMemoryPlan(const MemoryPlan& plan) {
+    const double MiB = 1 << 20;
+    stringstream text;
+    text << fixed << setprecision(1);
+    text << "planned peak " << plan.total_bytes / MiB << " MiB (parent " << plan.parent_bytes / MiB << " MiB";
+    if (plan.workers > 0) {
+        text << " + " << plan.workers << " workers x " << plan.worker_bytes / MiB << " MiB";
+    }
+    text << ")";
+    if (plan.limit_bytes > 0) {
+        text << ", limit " << plan.limit_bytes / MiB << " MiB";
+    }
+    for (size_t i = 0; i < plan.decisions.size(); i++) {
+        text << (i == 0 ? ": " : ", ") << plan.decisions[i];
+    }
+    return text.str();
+}
+
+// Function to get a monotonic timestamp in nanoseconds, comparable across processes
+uint64_t traceNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Function to create the shared trace segment. Children inherit the mapping on
+// fork; workers started with exec map it by name.
+void createTraceBuffer(int n_rings) {
+    size_t total_size = sizeof(TraceBuffer) + n_rings * sizeof(TraceRing);
+    
+    g_trace = static_cast<TraceBuffer*>(createSharedSegment(shmName("trace"), total_size));
+    g_trace->n_rings = n_rings;
+    g_trace->start_ns = traceNow();
+    
+    TraceRing* rings = reinterpret_cast<TraceRing*>(g_trace + 1);
+    for (int r = 0; r < n_rings; r++) {
+        rings[r].head.store(0, memory_order_relaxed);
+        rings[r].pid = 0;
+        rings[r].worker = r - 1;
+    }
+    
+    traceAttach(0);
+}
+
+// Function to resize the trace segment to n_rings rings once the worker count
+// is known, keeping the events recorded so far. Only the parent may be
+// running: the segment is replaced under the same name.
+void resizeTraceBuffer(int n_rings) {
+    if (g_trace == nullptr || g_trace->n_rings == n_rings) return;
+    
+    int kept = min(g_trace->n_rings, n_rings);
+    uint64_t start_ns = g_trace->start_ns;
+    vector<char> saved((char*)(g_trace + 1), (char*)(g_trace + 1) + kept * sizeof(TraceRing));
+    cleanupTraceBuffer();
+    
+    createTraceBuffer(n_rings);
+    g_trace->start_ns = start_ns;
+    memcpy(static_cast<void*>(g_trace + 1), saved.data(), saved.size());
+    traceAttach(0);
+}
+
+// Function to select the ring the calling process writes to
+void traceAttach(int ring) {
+    if (g_trace == nullptr || ring >= g_trace->n_rings) {
+        g_trace_ring = nullptr;
+        return;
+    }
+    g_trace_ring = reinterpret_cast<TraceRing*>(g_trace + 1) + ring;
+    g_trace_ring->pid = getpid();
+}
+
+// Function to get the CloneWorker of the calling clone worker from the stack
+// slot it runs on. Returns nullptr in any other process or thread.
+CloneWorker* currentCloneWorker() {
+    if (g_clone_stacks != nullptr) {
+        char probe;
+        uintptr_t sp = reinterpret_cast<uintptr_t>(&probe);
+        uintptr_t base = reinterpret_cast<uintptr_t>(g_clone_stacks);
+        if (sp >= base && sp < base + g_clone_stacks_size) {
+            uintptr_t slot = (sp - base) / g_clone_slot_size * g_clone_slot_size;
+            return reinterpret_cast<CloneWorker*>(base + slot);
+        }
+    }
+    return nullptr;
+}
+
+// Function to get the ring of the calling process. Clone workers share the
+// parent's globals, so their ring is looked up from the stack slot they run on.
+TraceRing* currentTraceRing() {
+    CloneWorker* worker = currentCloneWorker();
+    return worker != nullptr ? worker->trace_ring : g_trace_ring;
+}
+
+// Function to record a trace event. Does nothing unless tracing is enabled.
+void traceEvent(TracePhase phase, char type, int arg0, int arg1) {
+    if (g_trace == nullptr) return;
+    TraceRing* ring = currentTraceRing();
+    if (ring == nullptr) return;
+    
+    uint64_t head = ring->head.load(memory_order_relaxed);
+    TraceEvent& event = ring->events[head % TRACE_RING_CAPACITY];
+    event.ts_ns = traceNow();
+    event.arg0 = arg0;
+    event.arg1 = arg1;
+    event.phase = phase;
+    event.type = type;
+    ring->head.store(head + 1, memory_order_release);
+}
+
+// Function to write the recorded events in Chrome trace-event format (Perfetto)
+void exportTrace(const string& filename) {
+    if (g_trace == nullptr) return;
+    
+    ofstream file(filename);
+    if (!file.is_open()) {
+        cerr << "Error opening file for writing: " << filename << endl;
+        exit(1);
+    }
+    
+    file << fixed << setprecision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    
+    bool first = true;
+    TraceRing* rings = reinterpret_cast<TraceRing*>(g_trace + 1);
+    for (int r = 0; r < g_trace->n_rings; r++) {
+        TraceRing& ring = rings[r];
+        uint64_t head = ring.head.load(memory_order_acquire);
+        if (head == 0) continue;
+        
+        // Name the track after the process that owns it
+        file << (first ? "" : ",") << "\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << ring.pid
+             << ",\"tid\":" << ring.pid << ",\"args\":{\"name\":\""
+             << (ring.worker < 0 ? string("parent") : "worker " + to_string(ring.worker)) << "\"}}";
+        file << ",\n{\"name\":\"process_sort_index\",\"ph\":\"M\",\"pid\":" << ring.pid
+             << ",\"tid\":" << ring.pid << ",\"args\":{\"sort_index\":" << r << "}}";
+        first = false;
+        
+        // If the ring wrapped, skip end events whose begin was overwritten
+        uint64_t begin = head > TRACE_RING_CAPACITY ? head - TRACE_RING_CAPACITY : 0;
+        int depth = 0;
+        for (uint64_t e = begin; e < head; e++) {
+            const TraceEvent& event = ring.events[e % TRACE_RING_CAPACITY];
+            if (event.type == 'E' && depth == 0) continue;
+            depth += event.type == 'B' ? 1 : -1;
+            
+            double ts_us = (double)(event.ts_ns - g_trace->start_ns) / 1000.0;
+            file << ",\n{\"name\":\"" << TRACE_PHASE_NAMES[event.phase] << "\",\"ph\":\"" << event.type
+                 << "\",\"ts\":" << ts_us << ",\"pid\":" << ring.pid << ",\"tid\":" << ring.pid;
+            if (event.phase == PHASE_ROW_BLOCK || event.phase == PHASE_WORKER) {
+                file << ",\"args\":{\"start_row\":" << event.arg0 << ",\"end_row\":" << event.arg1 << "}";
+            }
+            file << "}";
+        }
+        if (begin > 0) {
+            cerr << "Warning: trace ring of " << (ring.worker < 0 ? string("parent") : "worker " + to_string(ring.worker))
+                 << " overflowed, " << begin << " oldest events dropped" << endl;
+        }
+    }
+    
+    file << "\n]}" << endl;
+    file.close();
+}
+
+// Function to release the trace segment
+void cleanupTraceBuffer() {
+    if (g_trace == nullptr) return;
+    cleanupSharedMemory(shmName("trace"), g_trace, sizeof(TraceBuffer) + g_trace->n_rings * sizeof(TraceRing));
+    g_trace = nullptr;
+    g_trace_ring = nullptr;
+}
+
+// Function registered with atexit to release the trace and spawn segments when
+// the run stops early (exit(1) or an error return from main). Workers leave
+// through _exit, or the raw exit of clone, and never run it; the check on the
+// pid covers any other child that calls exit.
+void cleanupAtExit() {
+    if (getpid() != g_cleanup_pid) return;
+    cleanupTraceBuffer();
+    cleanupSpawnResources();
+}
+
+void printUsage(const char* programName) {
+    cout << "Usage: " << programName << " <matrix_A_file> <matrix_B_file> [options]" << endl;
+    cout << "       " << programName << " --daemon <socket> [-n <workers>] [--max-jobs <k>] [--max-queue <q>] "
+         << "[--kernel <name>] [--tile <RxCxD>]" << endl;
+    cout << "Options:" << endl;
+    cout << "  -n <num_processes>   Number of processes to use (default: 1, sequential)" << endl;
+    cout << "                       'auto' uses the tuned configuration for this host and shape" << endl;
+    cout << "  -o <output_file>     Output file name (default: output.txt)" << endl;
+    cout << "  --trace <file>       Write a Chrome trace-event timeline of all phases and workers (open in Perfetto)" << endl;
+    cout << "  --verify=freivalds[:k]" << endl;
+    cout << "                       Check the parallel result with k random vectors (default: " << FREIVALDS_DEFAULT_ROUNDS << ")" << endl;
+    cout << "  --verify-tol <tol>   Relative tolerance for --verify (default: " << FREIVALDS_DEFAULT_TOLERANCE << ")" << endl;
+    cout << "  --no-baseline        Skip the sequential multiplication (no C_seq.txt, no speedup)" << endl;
+    cout << "  --kernel <name>      Worker kernel: naive, ikj or tiled (default: naive)" << endl;
+    cout << "  --tile <RxCxD>       Tile rows, columns and depth for the tiled kernel (default: 16x256x128)" << endl;
+    cout << "  --tune               Benchmark process counts, kernels and tiles, save the best for -n auto" << endl;
+    cout << "  --tune-file <file>   Tuning profile (default: $MATRIX_MUL_TUNE_FILE or ~/.matrix_mul_tune)" << endl;
+    cout << "  --cache              Reuse results of previous runs with identical inputs" << endl;
+    cout << "  --cache-dir <dir>    Cache directory, implies --cache (default: $MATRIX_MUL_CACHE_DIR or ~/.cache/matrix_mul)" << endl;
+    cout << "  --delta <dir>        Incremental mode: reuse A.bin, B.bin and C.bin of the previous run stored in dir," << endl;
+    cout << "                       recompute only what changed, then store the new A, B and C there" << endl;
+    cout << "  --spawn <strategy>   How workers are created: fork, vfork (vfork + exec) or clone (CLONE_VM) (default: fork)" << endl;
+    cout << "  --prefault           Populate shared memory pages when mapping them (MAP_POPULATE)" << endl;
+    cout << "  --pipeline           Load B first, then hand rows of A to the workers while A is being parsed" << endl;
+    cout << "  --transA, --transB   Multiply by the transpose of A or B, read in place without transposing the file" << endl;
+    cout << "  --mem-limit <size>   Plan the run to stay under size (MiB, or with a K, M or G suffix): the baseline" << endl;
+    cout << "                       is moved after the parallel run or skipped if needed; fails if it cannot fit" << endl;
+    cout << "  --summa <RxC>        Distributed SUMMA on an R x C grid of ranks over TCP, -n processes per rank." << endl;
+    cout << "                       Without --rank, all ranks run on this host" << endl;
+    cout << "  --rank <r>           Rank of this process in the grid (row-major)" << endl;
+    cout << "  --peers <list>       host:port of every rank, comma separated, in rank order" << endl;
+    cout << "  --cache-size <MiB>   Cache size limit, least recently used results are evicted (default: "
+         << CACHE_DEFAULT_SIZE_MB << ")" << endl;
+    cout << endl;
+    cout << "Daemon options:" << endl;
+    cout << "  -n <workers>         Worker processes kept in the pool (default: number of cores)" << endl;
+    cout << "  --max-jobs <k>       Jobs computed at the same time (default: " << DAEMON_DEFAULT_MAX_JOBS << ")" << endl;
+    cout << "  --max-queue <q>      Jobs waiting for a slot before new ones are rejected (default: "
+         << DAEMON_DEFAULT_MAX_QUEUE << ")" << endl;
+    cout << endl;
+    cout << "Examples:" << endl;
     cout << "  " << programName << " matrix_A.txt matrix_B.txt -n 4 -o result.txt" << endl;
     cout << "  " << programName << " matrix_A.txt matrix_B.txt -o result.txt" << endl;
     cout << "  " << programName << " matrix_A.txt matrix_B.txt" << endl;
+    cout << "  " << programName << " matrix_A.txt matrix_B.txt -n 8 --trace trace.json" << endl;
+    cout << "  " << programName << " matrix_A.txt matrix_B.txt -n 8 --no-baseline --verify=freivalds:5" << endl;
+    cout << "  " << programName << " matrix_A.txt matrix_B.txt --tune" << endl;
+    cout << "  " << programName << " matrix_A.txt matrix_B.txt -n auto" << endl;
+    cout << "  " << programName << " matrix_A.txt matrix_B.txt -n 2 --summa 2x2" << endl;
+    cout << "  " << programName << " --daemon /tmp/matrix_mul.sock -n 8 --kernel tiled" << endl;
 }
 
 int main(int argc, char* argv[]) {
+    // Workers started with vfork + exec
+    if (argc > 1 && string(argv[1]) == "--worker") {
+        return workerMain(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--daemon") {
+        return daemonMain(argc, argv);
+    }
+
+    // Shared memory of this run is released even on early exits
+    g_cleanup_pid = getpid();
+    atexit(cleanupAtExit);
+
     if (argc < 4) {
         printUsage(argv[0]);
         return 1;
@@ -374,29 +4274,331 @@ int main(int argc, char* argv[]) {
     string fileA = argv[1];
     string fileB = argv[2];
     int num_processes = -1;
+    string trace_file;
+    bool run_baseline = true;
+    int verify_rounds = 0;
+    double verify_tolerance = FREIVALDS_DEFAULT_TOLERANCE;
+    KernelConfig kernel_config;
+    bool kernel_given = false;
+    bool tune = false;
+    string tune_file = defaultTuningFile();
+    bool use_cache = false;
+    string cache_dir = defaultCacheDir();
+    long cache_size_mb = CACHE_DEFAULT_SIZE_MB;
+    string delta_dir;
+    bool pipeline = false;
+    bool trans_a = false;
+    bool trans_b = false;
+    double mem_limit = 0.0;
+    SummaGrid summa_grid;
+    g_shm_prefix = "/matrix_" + to_string(getpid()) + "_";
+
+    static struct option long_options[] = {
+        {"trace", required_argument, 0, 't'},
+        {"verify", required_argument, 0, 'v'},
+        {"verify-tol", required_argument, 0, 'T'},
+        {"no-baseline", no_argument, 0, 'B'},
+        {"kernel", required_argument, 0, 'k'},
+        {"tile", required_argument, 0, 'L'},
+        {"tune", no_argument, 0, 'U'},
+        {"tune-file", required_argument, 0, 'F'},
+        {"cache", no_argument, 0, 'c'},
+        {"cache-dir", required_argument, 0, 'D'},
+        {"cache-size", required_argument, 0, 'S'},
+        {"delta", required_argument, 0, 'd'},
+        {"pipeline", no_argument, 0, 'p'},
+        {"spawn", required_argument, 0, 's'},
+        {"prefault", no_argument, 0, 'P'},
+        {"summa", required_argument, 0, 'G'},
+        {"rank", required_argument, 0, 'R'},
+        {"peers", required_argument, 0, 'H'},
+        {"transA", no_argument, 0, 'a'},
+        {"transB", no_argument, 0, 'b'},
+        {"mem-limit", required_argument, 0, 'm'},
+        {0, 0, 0, 0}
+    };
 
     int opt;
-    while ((opt = getopt(argc - 2, argv + 2, "n:")) != -1) {
+    while ((opt = getopt_long(argc - 2, argv + 2, "n:", long_options, nullptr)) != -1) {
         switch (opt) {
             case 'n':
+                if (string(optarg) == "auto") {
+                    num_processes = AUTO_PROCESSES;
+                    break;
+                }
                 num_processes = atoi(optarg);
                 if (num_processes <= 0) {
                     cerr << "Error: Number of processes must be positive" << endl;
                     return 1;
                 }
                 break;
+            case 't':
+                trace_file = optarg;
+                break;
+            case 'v': {
+                string mode = optarg;
+                if (mode.rfind("freivalds", 0) != 0 ||
+                    (mode.size() > 9 && mode[9] != ':')) {
+                    cerr << "Error: Unknown verification mode: " << mode << endl;
+                    return 1;
+                }
+                verify_rounds = mode.size() > 10 ? atoi(mode.c_str() + 10) : FREIVALDS_DEFAULT_ROUNDS;
+                if (verify_rounds <= 0) {
+                    cerr << "Error: Number of verification rounds must be positive" << endl;
+                    return 1;
+                }
+                break;
+            }
+            case 'T':
+                verify_tolerance = atof(optarg);
+                if (verify_tolerance <= 0) {
+                    cerr << "Error: Verification tolerance must be positive" << endl;
+                    return 1;
+                }
+                break;
+            case 'B':
+                run_baseline = false;
+                break;
+            case 'k':
+                if (!parseKernelName(optarg, kernel_config.kernel)) {
+                    cerr << "Error: Unknown kernel: " << optarg << endl;
+                    return 1;
+                }
+                kernel_given = true;
+                break;
+            case 'L':
+                if (!parseTileSizes(optarg, kernel_config)) {
+                    cerr << "Error: Tile sizes must be given as <rows>x<cols>x<depth>" << endl;
+                    return 1;
+                }
+                break;
+            case 'U':
+                tune = true;
+                break;
+            case 'F':
+                tune_file = optarg;
+                break;
+            case 'c':
+                use_cache = true;
+                break;
+            case 'D':
+                use_cache = true;
+                cache_dir = optarg;
+                break;
+            case 'd':
+                delta_dir = optarg;
+                break;
+            case 'p':
+                pipeline = true;
+                break;
+            case 's':
+                if (!parseSpawnStrategy(optarg, g_spawn_strategy)) {
+                    cerr << "Error: Unknown spawn strategy: " << optarg << endl;
+                    return 1;
+                }
+                break;
+            case 'P':
+                g_prefault = true;
+                break;
+            case 'G':
+                if (!parseGridShape(optarg, summa_grid)) {
+                    cerr << "Error: The process grid must be given as <rows>x<cols>" << endl;
+                    return 1;
+                }
+                break;
+            case 'R':
+                summa_grid.rank = atoi(optarg);
+                break;
+            case 'a':
+                trans_a = true;
+                break;
+            case 'b':
+                trans_b = true;
+                break;
+            case 'm':
+                if (!parseMemorySize(optarg, mem_limit)) {
+                    cerr << "Error: Memory limit must be a positive size in MiB, or with a K, M or G suffix" << endl;
+                    return 1;
+                }
+                break;
+            case 'H':
+                if (!parsePeers(optarg, summa_grid.peers)) {
+                    cerr << "Error: Peers must be given as host:port,host:port,..." << endl;
+                    return 1;
+                }
+                break;
+            case 'S':
+                cache_size_mb = atol(optarg);
+                if (cache_size_mb <= 0) {
+                    cerr << "Error: Cache size must be positive" << endl;
+                    return 1;
+                }
+                break;
             default:
                 printUsage(argv[0]);
                 return 1;
         }
     }
 
+    // Tuning picks the process count, so it implies -n auto
+    if (num_processes == -1 && tune) {
+        num_processes = AUTO_PROCESSES;
+    }
+
     if (num_processes == -1) {
         cerr << "Error: -n <num_processes> is required." << endl;
         printUsage(argv[0]);
         return 1;
     }
 
+    // These modes need all of A before the multiplication starts
+    if (pipeline && (tune || use_cache || !delta_dir.empty())) {
+        cerr << "Error: --pipeline cannot be combined with --tune, --cache or --delta" << endl;
+        return 1;
+    }
+
+    // Transposed operands are supported by the shared memory kernels only. In
+    // pipelined mode the rows of A^T would only be complete once all of A is read.
+    if ((trans_a || trans_b) && (tune || !delta_dir.empty() || summa_grid.rows > 0 || (pipeline && trans_a))) {
+        cerr << "Error: --transA and --transB cannot be combined with --tune, --delta or --summa, "
+             << "nor --transA with --pipeline" << endl;
+        return 1;
+    }
+    kernel_config.trans_a = trans_a;
+    kernel_config.trans_b = trans_b;
+
+    // The planner does not model the tuning sweep nor the blocks of the distributed mode
+    if (mem_limit > 0 && (tune || summa_grid.rows > 0)) {
+        cerr << "Error: --mem-limit cannot be combined with --tune or --summa" << endl;
+        return 1;
+    }
+
+    // Distributed mode: each rank reads only its blocks, so it starts before the inputs are read
+    if (summa_grid.rows > 0) {
+        if (num_processes == AUTO_PROCESSES || tune || use_cache || !delta_dir.empty() || pipeline) {
+            cerr << "Error: --summa cannot be combined with -n auto, --tune, --cache, --delta or --pipeline" << endl;
+            return 1;
+        }
+        if (summa_grid.rank == -1) {
+            return launchSummaLocal(fileA, fileB, summa_grid, num_processes, kernel_config);
+        }
+        int size = summa_grid.rows * summa_grid.cols;
+        if (summa_grid.rank < 0 || summa_grid.rank >= size || (int)summa_grid.peers.size() != size) {
+            cerr << "Error: --rank must be below " << size << " and --peers must list " << size << " addresses" << endl;
+            return 1;
+        }
+        return runSummaRank(fileA, fileB, summa_grid, -1, num_processes, kernel_config);
+    }
+
+    // With a memory limit the run is planned from the shapes in the files, before anything is allocated
+    double base_bytes = procStatusKB("VmRSS") * 1024.0;
+    MemoryRequest memory_request;
+    memory_request.config = kernel_config;
+    memory_request.baseline = run_baseline;
+    memory_request.verify = verify_rounds > 0;
+    memory_request.pipeline = pipeline;
+    memory_request.delta = !delta_dir.empty();
+    MemoryPlan memory_plan;
+    if (mem_limit > 0) {
+        string error;
+        if (!peekMatrixShape(fileA, memory_request.rows_A, memory_request.cols_A, error) ||
+            !peekMatrixShape(fileB, memory_request.rows_B, memory_request.cols_B, error)) {
+            cerr << error << endl;
+            return 1;
+        }
+        // The count picked by -n auto is not known yet; assume one worker per core
+        memory_request.num_processes = num_processes != AUTO_PROCESSES ? num_processes :
+                                       (int)min<long>(sysconf(_SC_NPROCESSORS_ONLN), MAX_AUTO_PROCESSES);
+        memory_plan = planMemory(memory_request, base_bytes, mem_limit);
+        if (memory_plan.total_bytes > mem_limit) {
+            cerr << "Error: The run does not fit in the memory limit, " << describeMemoryPlan(memory_plan) << endl;
+            return 1;
+        }
+        if (memory_plan.drop_baseline) run_baseline = false;
+        g_fast_path_inline = memory_plan.inline_fast_path;
+    }
+
+    // One ring for the parent plus one per worker. The count picked by -n auto
+    // is not known yet: its rings are added once it is resolved.
+    if (!trace_file.empty()) {
+        createTraceBuffer((num_processes == AUTO_PROCESSES ? 0 : num_processes) + 1);
+    }
+
+    int N, M, P, M_B;
+    vector<vector<double>> A;
+    if (!pipeline) {
+        traceEvent(PHASE_READ_A, 'B');
+        A = readMatrix(fileA, N, M);
+        traceEvent(PHASE_READ_A, 'E');
+    }
+    traceEvent(PHASE_READ_B, 'B');
+    vector<vector<double>> B = readMatrix(fileB, M_B, P);
+    traceEvent(PHASE_READ_B, 'E');
+    if (pipeline) {
+        // Only the shape of A is needed now; it is parsed during the multiplication
+        long rows, cols;
+        string error;
+        if (!peekMatrixShape(fileA, rows, cols, error)) {
+            cerr << error << endl;
+            return 1;
+        }
+        N = rows;
+        M = cols;
+    }
+
+    // The files are used as stored; N, M and P describe op(A) * op(B)
+    if (trans_a) swap(N, M);
+    if (trans_b) swap(M_B, P);
+
+    if (M != M_B) {
+        cerr << "Error: Incompatible matrix dimensions for multiplication" << endl;
+        cerr << "Matrix A" << (trans_a ? "^T" : "") << ": " << N << "x" << M << endl;
+        cerr << "Matrix B" << (trans_b ? "^T" : "") << ": " << M_B << "x" << P << endl;
+        return 1;
+    }
+
+    // Resolve -n auto from a fresh tuning run or the saved profile
+    string config_source = "command line";
+    if (tune) {
+        traceEvent(PHASE_TUNE, 'B');
+        TuningEntry entry = tuneConfiguration(A, B);
+        traceEvent(PHASE_TUNE, 'E');
+        saveTuningEntry(tune_file, entry);
+        cout << "Tuning: saved " << entry.shape_class << " for " << entry.host << " to " << tune_file << endl;
+        if (num_processes == AUTO_PROCESSES) {
+            num_processes = entry.num_processes;
+            if (!kernel_given) kernel_config = entry.config;
+            config_source = "tuned (" + entry.shape_class + ")";
+        }
+    } else if (num_processes == AUTO_PROCESSES) {
+        TuningEntry entry;
+        if (lookupTuning(tune_file, N, M, P, entry)) {
+            num_processes = min({entry.num_processes, N, MAX_AUTO_PROCESSES});
+            if (!kernel_given) {
+                kernel_config = entry.config;
+                kernel_config.trans_a = trans_a;
+                kernel_config.trans_b = trans_b;
+            }
+            config_source = "profile " + tune_file + " (" + entry.shape_class + ")";
+        } else {
+            num_processes = min<long>({sysconf(_SC_NPROCESSORS_ONLN), N, MAX_AUTO_PROCESSES});
+            num_processes = max(num_processes, 1);
+            config_source = "default (no tuning profile for this host, run --tune)";
+        }
+    }
+    resizeTraceBuffer(num_processes + 1);
+
+    // Without a limit the plan is only logged, so it is made once the configuration is known
+    if (mem_limit <= 0) {
+        memory_request.rows_A = trans_a ? M : N;
+        memory_request.cols_A = trans_a ? N : M;
+        memory_request.rows_B = trans_b ? P : M_B;
+        memory_request.cols_B = trans_b ? M_B : P;
+        memory_request.num_processes = num_processes;
+        memory_request.config = kernel_config;
+        memory_plan = planMemory(memory_request, base_bytes, 0.0);
+    }
+
     string output_folder = "output_" + to_string(num_processes);
     string result_file_seq = output_folder + "/C_seq.txt";
     string result_file_par = output_folder + "/C_parallel_" + to_string(num_processes) + ".txt";
@@ -412,44 +4614,289 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    int N, M, P, M_B;
-    vector<vector<double>> A = readMatrix(fileA, N, M);
-    vector<vector<double>> B = readMatrix(fileB, M_B, P);
+    // Look for a previous result with the same inputs, before any multiplication
+    string cache_key;
+    bool cache_hit = false;
+    chrono::duration<double> hash_time(0), cache_time(0);
+    vector<vector<double>> C_par;
+    int prev_updates = 0;
+    if (use_cache) {
+        auto start_hash = chrono::high_resolution_clock::now();
+        traceEvent(PHASE_HASH, 'B');
+        cache_key = cacheKey(hashMatrix(A), hashMatrix(B), trans_a, trans_b);
+        traceEvent(PHASE_HASH, 'E');
+        auto end_hash = chrono::high_resolution_clock::now();
+        hash_time = end_hash - start_hash;
+        
+        auto start_cache = chrono::high_resolution_clock::now();
+        traceEvent(PHASE_CACHE, 'B');
+        cache_hit = cacheLookup(cache_dir, cache_key, N, P, C_par);
+        traceEvent(PHASE_CACHE, 'E');
+        auto end_cache = chrono::high_resolution_clock::now();
+        cache_time = end_cache - start_cache;
+    }
 
-    if (M != M_B) {
-        cerr << "Error: Incompatible matrix dimensions for multiplication" << endl;
-        cerr << "Matrix A: " << N << "x" << M << endl;
-        cerr << "Matrix B: " << M_B << "x" << P << endl;
-        return 1;
+    // Sequential multiplication. In pipelined mode A is only available after
+    // the parallel run, so the baseline runs afterwards; so does it when the
+    // memory plan keeps C_seq and the shared segments from being live together.
+    vector<vector<double>> C_seq;
+    chrono::duration<double> seq_time(0);
+    auto runBaseline = [&]() {
+        auto start_seq = chrono::high_resolution_clock::now();
+        traceEvent(PHASE_SEQUENTIAL, 'B');
+        C_seq = multiplyMatricesSequential(A, B, trans_a, trans_b);
+        traceEvent(PHASE_SEQUENTIAL, 'E');
+        auto end_seq = chrono::high_resolution_clock::now();
+        seq_time = end_seq - start_seq;
+    };
+    // A cache hit makes the comparison pointless, so it also skips the O(n^3) baseline
+    if (cache_hit) {
+        run_baseline = false;
+    }
+    bool baseline_after = pipeline || memory_plan.baseline_after;
+    if (run_baseline && !baseline_after) {
+        runBaseline();
+    }
+
+    // Parallel multiplication, skipped on a cache hit
+    chrono::duration<double> par_time(0);
+    DeltaStats delta_stats;
+    PipelineStats pipeline_stats;
+    if (pipeline) {
+        auto start_par = chrono::high_resolution_clock::now();
+        traceEvent(PHASE_PARALLEL, 'B');
+        C_par = multiplyMatricesPipelined(fileA, N, M, B, num_processes, kernel_config,
+                                          run_baseline || verify_rounds > 0, A, pipeline_stats);
+        traceEvent(PHASE_PARALLEL, 'E');
+        auto end_par = chrono::high_resolution_clock::now();
+        par_time = end_par - start_par;
+    } else if (!cache_hit) {
+        // State of the previous run for --delta, used only if all shapes still match
+        vector<vector<double>> prev_A, prev_B, prev_C;
+        if (!delta_dir.empty()) {
+            string prev_files[3] = {delta_dir + "/A.bin", delta_dir + "/B.bin", delta_dir + "/C.bin"};
+            
+            // Number of incremental updates applied since C was last computed in full
+            ifstream state(delta_dir + "/state.txt");
+            string key;
+            if (!(state >> key >> prev_updates) || key != "updates") {
+                prev_updates = 0;
+            }
+            
+            if (prev_updates >= DELTA_MAX_UPDATES) {
+                delta_stats.reason = "refresh after " + to_string(prev_updates) + " updates";
+            } else if (fs::exists(prev_files[0]) && fs::exists(prev_files[1]) && fs::exists(prev_files[2])) {
+                int rows_A, cols_A, rows_B, cols_B, rows_C, cols_C;
+                prev_A = readMatrix(prev_files[0], rows_A, cols_A);
+                prev_B = readMatrix(prev_files[1], rows_B, cols_B);
+                prev_C = readMatrix(prev_files[2], rows_C, cols_C);
+                if (rows_A != N || cols_A != M || rows_B != M || cols_B != P || rows_C != N || cols_C != P) {
+                    delta_stats.reason = "shapes changed";
+                    prev_A.clear();
+                }
+            } else {
+                delta_stats.reason = "no previous state";
+            }
+        }
+        
+        auto start_par = chrono::high_resolution_clock::now();
+        traceEvent(PHASE_PARALLEL, 'B');
+        if (!prev_A.empty()) {
+            C_par = multiplyMatricesDelta(A, B, prev_A, prev_B, prev_C, num_processes, kernel_config, delta_stats);
+            delta_stats.updates = delta_stats.incremental ? prev_updates + 1 : 0;
+        } else {
+            C_par = multiplyMatricesParallel(A, B, num_processes, kernel_config);
+        }
+        traceEvent(PHASE_PARALLEL, 'E');
+        auto end_par = chrono::high_resolution_clock::now();
+        par_time = end_par - start_par;
+    }
+
+    if (run_baseline && baseline_after) {
+        runBaseline();
+    }
+
+    int cache_evicted = 0;
+    bool cache_stored = false;
+    if (use_cache && !cache_hit) {
+        traceEvent(PHASE_CACHE, 'B');
+        cache_stored = cacheStore(cache_dir, cache_key, C_par, cache_size_mb * 1024 * 1024, cache_evicted);
+        traceEvent(PHASE_CACHE, 'E');
+    }
+
+    // Randomized verification of the parallel result
+    bool verified = true;
+    double max_residual = 0.0;
+    chrono::duration<double> verify_time(0);
+    if (verify_rounds > 0) {
+        auto start_verify = chrono::high_resolution_clock::now();
+        traceEvent(PHASE_VERIFY, 'B');
+        verified = verifyFreivalds(A, B, C_par, verify_rounds, verify_tolerance, max_residual, trans_a, trans_b);
+        traceEvent(PHASE_VERIFY, 'E');
+        auto end_verify = chrono::high_resolution_clock::now();
+        verify_time = end_verify - start_verify;
     }
 
-    // Sequential multiplication
-    auto start_seq = chrono::high_resolution_clock::now();
-    vector<vector<double>> C_seq = multiplyMatricesSequential(A, B);
-    auto end_seq = chrono::high_resolution_clock::now();
-    chrono::duration<double> seq_time = end_seq - start_seq;
+    // An incremental result that fails verification, or whose residual shows
+    // accumulated rounding error, is replaced by a full multiplication
+    if (delta_stats.incremental && verify_rounds > 0 && (!verified || max_residual > DELTA_REFRESH_RESIDUAL)) {
+        stringstream reason;
+        reason << "refresh, residual " << scientific << setprecision(2) << max_residual;
+        delta_stats.incremental = false;
+        delta_stats.reason = reason.str();
+        delta_stats.updates = 0;
+        
+        auto start_par = chrono::high_resolution_clock::now();
+        traceEvent(PHASE_PARALLEL, 'B');
+        C_par = multiplyMatricesParallel(A, B, num_processes, kernel_config);
+        traceEvent(PHASE_PARALLEL, 'E');
+        par_time += chrono::high_resolution_clock::now() - start_par;
+        
+        auto start_verify = chrono::high_resolution_clock::now();
+        traceEvent(PHASE_VERIFY, 'B');
+        verified = verifyFreivalds(A, B, C_par, verify_rounds, verify_tolerance, max_residual, trans_a, trans_b);
+        traceEvent(PHASE_VERIFY, 'E');
+        verify_time += chrono::high_resolution_clock::now() - start_verify;
+    }
 
-    // Parallel multiplication
-    auto start_par = chrono::high_resolution_clock::now();
-    vector<vector<double>> C_par = multiplyMatricesParallel(A, B, num_processes);
-    auto end_par = chrono::high_resolution_clock::now();
-    chrono::duration<double> par_time = end_par - start_par;
+    // Store the new state for the next --delta run. A result that failed
+    // verification must not become the base of the next update.
+    bool delta_stored = false;
+    if (!delta_dir.empty() && verified) {
+        error_code ec;
+        fs::create_directories(delta_dir, ec);
+        ofstream state(delta_dir + "/state.txt");
+        state << "updates " << delta_stats.updates << endl;
+        state.close();
+        if (!writeBinaryMatrix(delta_dir + "/A.bin", A) || !writeBinaryMatrix(delta_dir + "/B.bin", B) ||
+            !writeBinaryMatrix(delta_dir + "/C.bin", C_par) || !state) {
+            cerr << "Error: Could not write delta state to " << delta_dir << endl;
+            return 1;
+        }
+        delta_stored = true;
+    }
 
     // Write result matrices
-    writeMatrix(result_file_seq, C_seq);
+    traceEvent(PHASE_WRITE, 'B');
+    if (run_baseline) {
+        writeMatrix(result_file_seq, C_seq);
+    }
     writeMatrix(result_file_par, C_par);
+    traceEvent(PHASE_WRITE, 'E');
 
     // Logging
     log_stream << fixed << setprecision(6);
     cout << fixed << setprecision(6);
-    log_stream << "Sequential time: " << seq_time.count() << " seconds" << endl;
-    log_stream << "Parallel time (" << num_processes << " processes): " << par_time.count() << " seconds" << endl;
-    log_stream << "Speedup: " << (seq_time.count() / par_time.count()) << endl;
+    if (run_baseline) {
+        log_stream << "Sequential time: " << seq_time.count() << " seconds" << endl;
+    }
+    if (!cache_hit) {
+        log_stream << "Parallel time (" << num_processes << " processes): " << par_time.count() << " seconds" << endl;
+        if (run_baseline) {
+            log_stream << "Speedup: " << (seq_time.count() / par_time.count()) << endl;
+        }
+    }
+
+    if (run_baseline) {
+        cout << "Sequential time: " << seq_time.count() << " seconds" << endl;
+    }
+    if (!cache_hit) {
+        cout << "Parallel time (" << num_processes << " processes): " << par_time.count() << " seconds" << endl;
+        if (run_baseline) {
+            cout << "Speedup: " << (seq_time.count() / par_time.count()) << endl;
+        }
+    }
+
+    if (g_spawn_stats.workers > 0) {
+        log_stream << "Spawn (" << SPAWN_NAMES[g_spawn_strategy] << (g_prefault ? ", prefaulted" : "") << "): "
+                   << g_spawn_stats.workers << " workers, child start latency mean " << g_spawn_stats.child_mean_us
+                   << " us, max " << g_spawn_stats.child_max_us << " us, parent cost " << g_spawn_stats.parent_mean_us
+                   << " us per child" << endl;
+        cout << "Spawn (" << SPAWN_NAMES[g_spawn_strategy] << (g_prefault ? ", prefaulted" : "") << "): "
+             << g_spawn_stats.workers << " workers, child start latency mean " << g_spawn_stats.child_mean_us
+             << " us, max " << g_spawn_stats.child_max_us << " us, parent cost " << g_spawn_stats.parent_mean_us
+             << " us per child" << endl;
+    }
+
+    if (g_fast_path_stats.shape != SHAPE_GENERAL && !cache_hit) {
+        stringstream line;
+        line << fixed << setprecision(6);
+        line << "Fast path (" << FAST_PATH_NAMES[g_fast_path_stats.shape] << ", "
+             << (g_fast_path_stats.inline_run ? string("inline") : to_string(g_fast_path_stats.workers) + " workers")
+             << (g_fast_path_stats.calls > 1 ? ", " + to_string(g_fast_path_stats.calls) + " calls" : string())
+             << "): " << g_fast_path_stats.bytes / 1e6 << " MB in " << g_fast_path_stats.seconds << " seconds";
+        if (g_fast_path_stats.seconds > 0) {
+            line << ", " << g_fast_path_stats.bytes / g_fast_path_stats.seconds / 1e9 << " GB/s";
+        }
+        line << endl;
+        log_stream << line.str();
+        cout << line.str();
+    }
+
+    if (pipeline) {
+        log_stream << "Pipeline: " << pipeline_stats.panels << " panels of " << pipeline_stats.panel_rows
+                   << " rows, A parsed in " << pipeline_stats.parse_seconds << " seconds (included in parallel time)" << endl;
+        cout << "Pipeline: " << pipeline_stats.panels << " panels of " << pipeline_stats.panel_rows
+             << " rows, A parsed in " << pipeline_stats.parse_seconds << " seconds (included in parallel time)" << endl;
+    }
+
+    if (!delta_dir.empty() && !cache_hit) {
+        string delta_mode = delta_stats.incremental
+            ? "incremental (update " + to_string(delta_stats.updates) + " of " + to_string(DELTA_MAX_UPDATES) + ")"
+            : "full (" + delta_stats.reason + ")";
+        string delta_state = delta_stored ? "" : ", state not stored (verification failed)";
+        log_stream << "Delta: " << delta_mode << ", changed rows of A: " << delta_stats.changed_rows_A
+                   << ", changed rows of B: " << delta_stats.changed_rows_B << delta_state << endl;
+        cout << "Delta: " << delta_mode << ", changed rows of A: " << delta_stats.changed_rows_A
+             << ", changed rows of B: " << delta_stats.changed_rows_B << delta_state << endl;
+    }
+
+    if (use_cache) {
+        string cache_status = cache_hit ? "hit" : (cache_stored ? "miss, stored" : "miss, not stored");
+        log_stream << "Cache " << cache_status << ": " << cache_key << " (hash time: " << hash_time.count()
+                   << " seconds, lookup time: " << cache_time.count() << " seconds, evicted: " << cache_evicted << ")" << endl;
+        cout << "Cache " << cache_status << ": " << cache_key << " (hash time: " << hash_time.count()
+             << " seconds, lookup time: " << cache_time.count() << " seconds, evicted: " << cache_evicted << ")" << endl;
+    }
 
-    cout << "Sequential time: " << seq_time.count() << " seconds" << endl;
-    cout << "Parallel time (" << num_processes << " processes): " << par_time.count() << " seconds" << endl;
-    cout << "Speedup: " << (seq_time.count() / par_time.count()) << endl;
+    log_stream << "Configuration: " << num_processes << " processes, kernel " << describeKernel(kernel_config)
+               << ", source: " << config_source << endl;
+    cout << "Configuration: " << num_processes << " processes, kernel " << describeKernel(kernel_config)
+         << ", source: " << config_source << endl;
+
+    // A worker's peak resident size includes the pages it shares with the parent
+    struct rusage children_usage;
+    getrusage(RUSAGE_CHILDREN, &children_usage);
+    stringstream memory_line;
+    memory_line << fixed << setprecision(1);
+    memory_line << "Memory: " << describeMemoryPlan(memory_plan) << "; actual peak RSS " << procStatusKB("VmHWM") / 1024.0
+                << " MiB";
+    if (children_usage.ru_maxrss > 0) {
+        memory_line << ", largest worker " << children_usage.ru_maxrss / 1024.0 << " MiB";
+    }
+    memory_line << endl;
+    log_stream << memory_line.str();
+    cout << memory_line.str();
+
+    if (verify_rounds > 0) {
+        const char* verdict = verified ? "PASSED" : "FAILED";
+        log_stream << "Verification (freivalds, k=" << verify_rounds << "): " << verdict
+                   << ", max relative residual: " << scientific << max_residual << fixed
+                   << ", time: " << verify_time.count() << " seconds" << endl;
+        cout << "Verification (freivalds, k=" << verify_rounds << "): " << verdict
+             << ", max relative residual: " << scientific << max_residual << fixed
+             << ", time: " << verify_time.count() << " seconds" << endl;
+    }
+
+    if (!trace_file.empty()) {
+        exportTrace(trace_file);
+        cleanupTraceBuffer();
+        log_stream << "Trace written to: " << trace_file << endl;
+        cout << "Trace written to: " << trace_file << endl;
+    }
+
+    cleanupSpawnResources();
 
     log_stream.close();
-    return 0;
+    return verified ? 0 : 1;
 }
\ No newline at end of file
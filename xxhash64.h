@@ -0,0 +1,150 @@
+/*
+ * University of Antioquia - Operating Systems Course
+ * Practice #3 - Matrix Multiplication Using Processes
+ *
+ * Streaming implementation of the 64-bit xxHash algorithm (XXH64), used to
+ * fingerprint matrices. Produces the same digests as the reference library.
+ */
+
+#ifndef XXHASH64_H
+#define XXHASH64_H
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+class XXH64 {
+public:
+    explicit XXH64(uint64_t seed = 0) { reset(seed); }
+
+    void reset(uint64_t seed = 0) {
+        v1_ = seed + PRIME1 + PRIME2;
+        v2_ = seed + PRIME2;
+        v3_ = seed;
+        v4_ = seed - PRIME1;
+        seed_ = seed;
+        total_len_ = 0;
+        buffered_ = 0;
+    }
+
+    void update(const void* data, size_t len) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        const unsigned char* end = p + len;
+        total_len_ += len;
+
+        // Complete a partially filled stripe first
+        if (buffered_ > 0) {
+            size_t fill = 32 - buffered_;
+            if (len < fill) {
+                memcpy(buffer_ + buffered_, p, len);
+                buffered_ += len;
+                return;
+            }
+            memcpy(buffer_ + buffered_, p, fill);
+            consumeStripe(buffer_);
+            p += fill;
+            buffered_ = 0;
+        }
+
+        while (end - p >= 32) {
+            consumeStripe(p);
+            p += 32;
+        }
+
+        buffered_ = end - p;
+        memcpy(buffer_, p, buffered_);
+    }
+
+    uint64_t digest() const {
+        uint64_t h;
+        if (total_len_ >= 32) {
+            h = rotl(v1_, 1) + rotl(v2_, 7) + rotl(v3_, 12) + rotl(v4_, 18);
+            h = mergeRound(h, v1_);
+            h = mergeRound(h, v2_);
+            h = mergeRound(h, v3_);
+            h = mergeRound(h, v4_);
+        } else {
+            h = seed_ + PRIME5;
+        }
+        h += total_len_;
+
+        const unsigned char* p = buffer_;
+        const unsigned char* end = buffer_ + buffered_;
+        while (end - p >= 8) {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * PRIME1 + PRIME4;
+            p += 8;
+        }
+        if (end - p >= 4) {
+            h ^= (uint64_t)read32(p) * PRIME1;
+            h = rotl(h, 23) * PRIME2 + PRIME3;
+            p += 4;
+        }
+        while (p < end) {
+            h ^= (*p) * PRIME5;
+            h = rotl(h, 11) * PRIME1;
+            p++;
+        }
+
+        h ^= h >> 33;
+        h *= PRIME2;
+        h ^= h >> 29;
+        h *= PRIME3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    static const uint64_t PRIME1 = 11400714785074694791ULL;
+    static const uint64_t PRIME2 = 14029467366897019727ULL;
+    static const uint64_t PRIME3 = 1609587929392839161ULL;
+    static const uint64_t PRIME4 = 9650029242287828579ULL;
+    static const uint64_t PRIME5 = 2870177450012600261ULL;
+
+    static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    static uint64_t read64(const unsigned char* p) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static uint32_t read32(const unsigned char* p) {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static uint64_t round(uint64_t acc, uint64_t input) {
+        acc += input * PRIME2;
+        acc = rotl(acc, 31);
+        return acc * PRIME1;
+    }
+
+    static uint64_t mergeRound(uint64_t acc, uint64_t val) {
+        acc ^= round(0, val);
+        return acc * PRIME1 + PRIME4;
+    }
+
+    void consumeStripe(const unsigned char* p) {
+        v1_ = round(v1_, read64(p));
+        v2_ = round(v2_, read64(p + 8));
+        v3_ = round(v3_, read64(p + 16));
+        v4_ = round(v4_, read64(p + 24));
+    }
+
+    uint64_t v1_, v2_, v3_, v4_;
+    uint64_t seed_;
+    uint64_t total_len_;
+    unsigned char buffer_[32];
+    size_t buffered_;
+};
+
+// Function to hash a buffer in one call
+inline uint64_t xxh64(const void* data, size_t len, uint64_t seed = 0) {
+    XXH64 state(seed);
+    state.update(data, len);
+    return state.digest();
+}
+
+#endif // XXHASH64_H